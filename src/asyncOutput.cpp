@@ -0,0 +1,187 @@
+#include "asyncOutput.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+/*************/
+AsyncOutput::AsyncOutput(unique_ptr<FrameSink> output, unsigned int queueSize, Policy policy)
+{
+    _output = move(output);
+    _queueSize = max(1u, queueSize);
+    _policy = policy;
+
+    if (!_output || !*_output)
+        return;
+
+    _thread = thread([&]() {
+        run();
+    });
+}
+
+/*************/
+AsyncOutput::~AsyncOutput()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _frameCondition.notify_all();
+    _roomCondition.notify_all();
+
+    // The sink thread may be waiting for a stalled consumer
+    if (_output)
+        _output->interrupt();
+
+    if (_thread.joinable())
+        _thread.join();
+
+    for (auto& frame : _queue)
+        drop(frame);
+}
+
+/*************/
+bool AsyncOutput::push(const cv::Mat& frame)
+{
+    if (!_output || !*_output)
+        return false;
+
+    unique_lock<mutex> lock(_mutex);
+    _stats.pushed++;
+
+    if (_queue.size() >= _queueSize)
+    {
+        if (_policy == Policy::dropNewest)
+        {
+            _stats.dropped++;
+            drop(frame);
+            return false;
+        }
+        else if (_policy == Policy::dropOldest)
+        {
+            _stats.dropped++;
+            drop(_queue.front());
+            _queue.pop_front();
+        }
+        else
+        {
+            _roomCondition.wait(lock, [&]() {return _stop || _queue.size() < _queueSize;});
+            if (_stop)
+                return false;
+        }
+    }
+
+    _queue.push_back(frame);
+    _stats.queued = _queue.size();
+    lock.unlock();
+
+    _frameCondition.notify_one();
+    return true;
+}
+
+/*************/
+uint8_t* AsyncOutput::acquireBuffer()
+{
+    if (!_output || !_output->isStreaming())
+        return nullptr;
+    return _output->acquireBuffer(false);
+}
+
+/*************/
+void AsyncOutput::releaseBuffer(const uint8_t* data)
+{
+    if (_output)
+        _output->releaseBuffer(data);
+}
+
+/*************/
+AsyncOutput::Stats AsyncOutput::getStats()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _stats;
+}
+
+/*************/
+string AsyncOutput::getPolicyName(Policy policy)
+{
+    switch (policy)
+    {
+    default:
+    case Policy::dropOldest:
+        return "dropOldest";
+    case Policy::dropNewest:
+        return "dropNewest";
+    case Policy::block:
+        return "block";
+    }
+}
+
+/*************/
+bool AsyncOutput::getPolicyFromName(const string& name, Policy& policy)
+{
+    for (auto candidate : {Policy::dropOldest, Policy::dropNewest, Policy::block})
+    {
+        if (getPolicyName(candidate) == name)
+        {
+            policy = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*************/
+void AsyncOutput::run()
+{
+    while (true)
+    {
+        cv::Mat frame;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _frameCondition.wait(lock, [&]() {return _stop || _queue.size() != 0;});
+            if (_stop)
+                return;
+
+            frame = _queue.front();
+            _queue.pop_front();
+            _stats.queued = _queue.size();
+        }
+        _roomCondition.notify_one();
+
+        auto start = chrono::high_resolution_clock::now();
+        bool success;
+        if (_output->isDeviceBuffer(frame.data))
+            success = _output->queueBuffer(frame.data);
+        else
+            success = _output->writeToDevice(frame.data, frame.total() * frame.elemSize());
+
+        // Keep a sink buffer available for the render thread. This is
+        // where a stalled consumer blocks, instead of in the render loop
+        if (_output->needsBufferReclaim())
+            _output->releaseBuffer(_output->acquireBuffer(true));
+        auto end = chrono::high_resolution_clock::now();
+
+        frame.release();
+
+        lock_guard<mutex> lock(_mutex);
+        double writeTime = chrono::duration_cast<chrono::microseconds>(end - start).count() / 1000.0;
+        if (success)
+            _stats.written++;
+        else
+            _stats.errors++;
+        _totalWriteTime += writeTime;
+        _stats.lastWriteTime = writeTime;
+        _stats.maxWriteTime = max(_stats.maxWriteTime, writeTime);
+        _stats.meanWriteTime = _totalWriteTime / (_stats.written + _stats.errors);
+    }
+}
+
+/*************/
+void AsyncOutput::drop(const cv::Mat& frame)
+{
+    if (_output->isDeviceBuffer(frame.data))
+        _output->releaseBuffer(frame.data);
+}
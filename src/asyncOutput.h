@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ASYNCOUTPUT_H
+#define ASYNCOUTPUT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "./frameSink.h"
+
+/*************/
+// Sends frames to a sink from a dedicated thread, so that a stalled
+// consumer does not block the render loop
+class AsyncOutput
+{
+    public:
+        // What to do with a new frame when the queue is full
+        enum class Policy
+        {
+            dropOldest, // Replace the oldest queued frame, the latency stays low
+            dropNewest, // Drop the new frame
+            block // Wait for the sink thread to make room
+        };
+
+        struct Stats
+        {
+            uint64_t pushed {0}; // Frames given to push
+            uint64_t written {0}; // Frames sent to the sink
+            uint64_t dropped {0}; // Frames dropped by the queue policy
+            uint64_t errors {0}; // Frames the sink refused
+            unsigned int queued {0}; // Frames currently waiting
+            double lastWriteTime {0.0}; // In milliseconds
+            double meanWriteTime {0.0};
+            double maxWriteTime {0.0};
+        };
+
+        AsyncOutput(std::unique_ptr<FrameSink> output, unsigned int queueSize = 2, Policy policy = Policy::dropOldest);
+        ~AsyncOutput();
+
+        explicit operator bool() const {return _output && *_output;}
+
+        // Queue a frame already converted to the output format
+        // The frame is referenced, not copied: it should not be modified afterwards
+        // Returns false if the frame has been dropped
+        bool push(const cv::Mat& frame);
+
+        // Get a sink buffer to convert the next frame into, without waiting
+        // Returns nullptr if the sink is not streaming or if no buffer is available
+        // The buffer must then be pushed, or given back with releaseBuffer
+        uint8_t* acquireBuffer();
+        void releaseBuffer(const uint8_t* data);
+
+        Stats getStats();
+
+        int getWidth() {return _output->getWidth();}
+        int getHeight() {return _output->getHeight();}
+        size_t getFrameSize() {return _output->getFrameSize();}
+
+        static std::string getPolicyName(Policy policy);
+        static bool getPolicyFromName(const std::string& name, Policy& policy);
+
+    private:
+        std::unique_ptr<FrameSink> _output;
+        unsigned int _queueSize {2};
+        Policy _policy {Policy::dropOldest};
+
+        std::thread _thread {};
+        std::mutex _mutex {};
+        std::condition_variable _frameCondition {};
+        std::condition_variable _roomCondition {};
+        std::deque<cv::Mat> _queue {};
+        bool _stop {false};
+
+        Stats _stats {};
+        double _totalWriteTime {0.0};
+
+        void run();
+
+        // Drop a queued frame, giving its sink buffer back if any
+        void drop(const cv::Mat& frame);
+};
+
+#endif
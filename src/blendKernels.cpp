@@ -0,0 +1,358 @@
+#include "blendKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BLEND_HAVE_X86 1
+#include <immintrin.h>
+#else
+#define BLEND_HAVE_X86 0
+#endif
+
+using namespace std;
+
+namespace blend
+{
+
+typedef void (*BlendFunction)(uint8_t*, const uint8_t*, const uint8_t*, size_t);
+typedef void (*AddFunction)(uint8_t*, const uint8_t*, size_t);
+
+struct Functions
+{
+    BlendFunction blendWithAlpha;
+    BlendFunction multiplyAndBlendWithAlpha;
+    AddFunction addSaturate;
+};
+
+/*************/
+static void blendWithAlphaScalar(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned int a = alpha[i];
+        dst[i] = div255((255 - a) * dst[i] + a * src[i]);
+    }
+}
+
+/*************/
+static void multiplyAndBlendWithAlphaScalar(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned int a = alpha[i];
+        unsigned int premultiplied = div255Round(src[i] * a);
+        dst[i] = div255((255 - a) * dst[i] + a * premultiplied);
+    }
+}
+
+/*************/
+static void addSaturateScalar(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        unsigned int sum = dst[i] + src[i];
+        dst[i] = sum > 255 ? 255 : sum;
+    }
+}
+
+#if BLEND_HAVE_X86
+/*************/
+// Vectorized div255, on 16 bits values
+__attribute__((target("sse2")))
+static inline __m128i div255Epu16(__m128i x)
+{
+    __m128i t = _mm_add_epi16(x, _mm_set1_epi16(1));
+    t = _mm_add_epi16(t, _mm_srli_epi16(x, 8));
+    return _mm_srli_epi16(t, 8);
+}
+
+/*************/
+__attribute__((target("sse2")))
+static void blendWithAlphaSSE2(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(255);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i));
+
+        __m128i aLo = _mm_unpacklo_epi8(a, zero);
+        __m128i aHi = _mm_unpackhi_epi8(a, zero);
+
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(full, aLo), _mm_unpacklo_epi8(d, zero)),
+                                   _mm_mullo_epi16(aLo, _mm_unpacklo_epi8(s, zero)));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(full, aHi), _mm_unpackhi_epi8(d, zero)),
+                                   _mm_mullo_epi16(aHi, _mm_unpackhi_epi8(s, zero)));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(div255Epu16(lo), div255Epu16(hi)));
+    }
+
+    blendWithAlphaScalar(dst + i, src + i, alpha + i, count - i);
+}
+
+/*************/
+__attribute__((target("sse2")))
+static inline __m128i multiplyAndBlendEpu16(__m128i d, __m128i s, __m128i a)
+{
+    const __m128i full = _mm_set1_epi16(255);
+    const __m128i half = _mm_set1_epi16(127);
+
+    __m128i premultiplied = div255Epu16(_mm_add_epi16(_mm_mullo_epi16(s, a), half));
+    __m128i blended = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(full, a), d), _mm_mullo_epi16(a, premultiplied));
+    return div255Epu16(blended);
+}
+
+/*************/
+__attribute__((target("sse2")))
+static void multiplyAndBlendWithAlphaSSE2(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(alpha + i));
+
+        __m128i lo = multiplyAndBlendEpu16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(a, zero));
+        __m128i hi = multiplyAndBlendEpu16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(a, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+    }
+
+    multiplyAndBlendWithAlphaScalar(dst + i, src + i, alpha + i, count - i);
+}
+
+/*************/
+__attribute__((target("sse2")))
+static void addSaturateSSE2(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epu8(d, s));
+    }
+
+    addSaturateScalar(dst + i, src + i, count - i);
+}
+
+/*************/
+__attribute__((target("avx2")))
+static inline __m256i div255Epu16AVX2(__m256i x)
+{
+    __m256i t = _mm256_add_epi16(x, _mm256_set1_epi16(1));
+    t = _mm256_add_epi16(t, _mm256_srli_epi16(x, 8));
+    return _mm256_srli_epi16(t, 8);
+}
+
+/*************/
+__attribute__((target("avx2")))
+static void blendWithAlphaAVX2(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+
+    // Unpack and pack both work within 128 bits lanes, so the byte order is kept
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+
+        __m256i aLo = _mm256_unpacklo_epi8(a, zero);
+        __m256i aHi = _mm256_unpackhi_epi8(a, zero);
+
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(full, aLo), _mm256_unpacklo_epi8(d, zero)),
+                                      _mm256_mullo_epi16(aLo, _mm256_unpacklo_epi8(s, zero)));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(full, aHi), _mm256_unpackhi_epi8(d, zero)),
+                                      _mm256_mullo_epi16(aHi, _mm256_unpackhi_epi8(s, zero)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(div255Epu16AVX2(lo), div255Epu16AVX2(hi)));
+    }
+
+    blendWithAlphaSSE2(dst + i, src + i, alpha + i, count - i);
+}
+
+/*************/
+__attribute__((target("avx2")))
+static inline __m256i multiplyAndBlendEpu16AVX2(__m256i d, __m256i s, __m256i a)
+{
+    const __m256i full = _mm256_set1_epi16(255);
+    const __m256i half = _mm256_set1_epi16(127);
+
+    __m256i premultiplied = div255Epu16AVX2(_mm256_add_epi16(_mm256_mullo_epi16(s, a), half));
+    __m256i blended = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(full, a), d), _mm256_mullo_epi16(a, premultiplied));
+    return div255Epu16AVX2(blended);
+}
+
+/*************/
+__attribute__((target("avx2")))
+static void multiplyAndBlendWithAlphaAVX2(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(alpha + i));
+
+        __m256i lo = multiplyAndBlendEpu16AVX2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(a, zero));
+        __m256i hi = multiplyAndBlendEpu16AVX2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(a, zero));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo, hi));
+    }
+
+    multiplyAndBlendWithAlphaSSE2(dst + i, src + i, alpha + i, count - i);
+}
+
+/*************/
+__attribute__((target("avx2")))
+static void addSaturateAVX2(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epu8(d, s));
+    }
+
+    addSaturateSSE2(dst + i, src + i, count - i);
+}
+#endif
+
+/*************/
+static bool isSupported(Kernel kernel)
+{
+    switch (kernel)
+    {
+    default:
+        return false;
+    case Kernel::automatic:
+    case Kernel::scalar:
+        return true;
+#if BLEND_HAVE_X86
+    case Kernel::sse2:
+        return __builtin_cpu_supports("sse2");
+    case Kernel::avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+}
+
+/*************/
+static Kernel detectKernel()
+{
+    if (isSupported(Kernel::avx2))
+        return Kernel::avx2;
+    else if (isSupported(Kernel::sse2))
+        return Kernel::sse2;
+    else
+        return Kernel::scalar;
+}
+
+/*************/
+static Functions getFunctions(Kernel kernel)
+{
+    switch (kernel)
+    {
+    default:
+        return {blendWithAlphaScalar, multiplyAndBlendWithAlphaScalar, addSaturateScalar};
+#if BLEND_HAVE_X86
+    case Kernel::sse2:
+        return {blendWithAlphaSSE2, multiplyAndBlendWithAlphaSSE2, addSaturateSSE2};
+    case Kernel::avx2:
+        return {blendWithAlphaAVX2, multiplyAndBlendWithAlphaAVX2, addSaturateAVX2};
+#endif
+    }
+}
+
+static Kernel _currentKernel = detectKernel();
+static Functions _functions = getFunctions(_currentKernel);
+
+/*************/
+void blendWithAlpha(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    _functions.blendWithAlpha(dst, src, alpha, count);
+}
+
+/*************/
+void multiplyAndBlendWithAlpha(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    _functions.multiplyAndBlendWithAlpha(dst, src, alpha, count);
+}
+
+/*************/
+void addSaturate(uint8_t* dst, const uint8_t* src, size_t count)
+{
+    _functions.addSaturate(dst, src, count);
+}
+
+/*************/
+void multiply(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = div255Round(src[i] * alpha[i]);
+}
+
+/*************/
+void expandAlpha(uint8_t* dst, const uint8_t* mask, size_t pixels, int channels)
+{
+    if (channels == 3)
+    {
+        for (size_t i = 0; i < pixels; ++i, dst += 3)
+            dst[0] = dst[1] = dst[2] = mask[i];
+    }
+    else
+    {
+        for (size_t i = 0; i < pixels; ++i)
+            for (int c = 0; c < channels; ++c)
+                *dst++ = mask[i];
+    }
+}
+
+/*************/
+bool setKernel(Kernel kernel)
+{
+    if (!isSupported(kernel))
+        return false;
+
+    if (kernel == Kernel::automatic)
+        kernel = detectKernel();
+
+    _currentKernel = kernel;
+    _functions = getFunctions(kernel);
+    return true;
+}
+
+/*************/
+Kernel getKernel()
+{
+    return _currentKernel;
+}
+
+/*************/
+string getKernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    default:
+        return "automatic";
+    case Kernel::scalar:
+        return "scalar";
+    case Kernel::sse2:
+        return "sse2";
+    case Kernel::avx2:
+        return "avx2";
+    }
+}
+
+} // namespace blend
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLENDKERNELS_H
+#define BLENDKERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*************/
+namespace blend
+{
+    enum class Kernel
+    {
+        automatic = 0,
+        scalar,
+        sse2,
+        avx2
+    };
+
+    // Exact x / 255, for x in [0, 65534] which covers any product of two bytes
+    // This is what all kernels use instead of an integer division
+    inline uint32_t div255(uint32_t x)
+    {
+        return (x + 1 + (x >> 8)) >> 8;
+    }
+
+    // Same as div255, rounded to the nearest integer. A product of two bytes
+    // divided by 255 never ends in .5, so there is no tie to break
+    inline uint32_t div255Round(uint32_t x)
+    {
+        return div255(x + 127);
+    }
+
+    // Multiplies src by alpha, byte per byte: dst = round(src * alpha / 255)
+    // This is the premultiplication done by multiplyAndBlendWithAlpha, dst may be src
+    void multiply(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count);
+
+    // Blends src over dst, byte per byte:
+    // dst = ((255 - alpha) * dst + alpha * src) / 255
+    // All kernels give the exact same result as the integer division
+    void blendWithAlpha(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count);
+
+    // Same as blendWithAlpha, but src is multiplied by alpha first:
+    // dst = ((255 - alpha) * dst + alpha * round(src * alpha / 255)) / 255
+    // This matches cv::Mat::mul(alpha, 1.0 / 255.0) followed by blendWithAlpha
+    void multiplyAndBlendWithAlpha(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count);
+
+    // Adds src to dst with saturation, byte per byte: dst = min(dst + src, 255)
+    // src may be dst, which doubles the values
+    void addSaturate(uint8_t* dst, const uint8_t* src, size_t count);
+
+    // Repeats each value of a single channel mask for the given number of channels
+    void expandAlpha(uint8_t* dst, const uint8_t* mask, size_t pixels, int channels);
+
+    // Same as expandAlpha, with the number of channels known at compile time
+    template<int Channels>
+    inline void expandAlpha(uint8_t* dst, const uint8_t* mask, size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; ++i)
+            for (int c = 0; c < Channels; ++c)
+                dst[i * Channels + c] = mask[i];
+    }
+
+    // Force the kernel to use, mainly for benchmarking. The automatic kernel
+    // is the fastest one supported by the CPU. Returns false if the kernel
+    // is not supported, in which case the current one is kept
+    bool setKernel(Kernel kernel);
+    Kernel getKernel();
+    std::string getKernelName(Kernel kernel);
+}
+
+#endif
@@ -2,21 +2,25 @@
 
 #include <iostream>
 
+#include "./blendKernels.h"
+
 using namespace std;
 
 /*************/
-FilmPlayer::FilmPlayer(string path, int frameNbr, int planeNbr, float fps)
+FilmPlayer::FilmPlayer(string path, int frameNbr, int planeNbr, float fps, bool premultiplied)
 {
     _path = path;
     _frameNbr = frameNbr;
     _planeNbr = planeNbr;
     _fps = fps;
+    _premultiplied = premultiplied;
 
     _frames.clear();
     for (int i = 1; i <= frameNbr; ++i)
     {
         vector<cv::Mat> frames;
         vector<cv::Mat> masks;
+        vector<MaskTiles> maskTiles;
 
         for (int p = 1; p <= planeNbr; ++p)
         {
@@ -50,6 +54,22 @@ FilmPlayer::FilmPlayer(string path, int frameNbr, int planeNbr, float fps)
 
                     cv::cvtColor(frame, frames[frames.size() - 1], cv::COLOR_RGBA2RGB);
                 }
+
+                // Same fixed-point multiplication as the one done by LayerMerger for straight layers
+                if (_premultiplied)
+                {
+                    auto& plane = frames[frames.size() - 1];
+                    auto& mask = masks[masks.size() - 1];
+                    int channels = plane.channels();
+                    vector<uint8_t> alphaRow(plane.cols * channels);
+                    for (int y = 0; y < plane.rows; ++y)
+                    {
+                        blend::expandAlpha(alphaRow.data(), mask.ptr<uint8_t>(y), plane.cols, channels);
+                        blend::multiply(plane.ptr<uint8_t>(y), plane.ptr<uint8_t>(y), alphaRow.data(), alphaRow.size());
+                    }
+                }
+
+                maskTiles.emplace_back(masks[masks.size() - 1]);
             }
             else if (frame.channels() == 4)
             {
@@ -59,6 +79,19 @@ FilmPlayer::FilmPlayer(string path, int frameNbr, int planeNbr, float fps)
 
         _frames.emplace_back(frames);
         _masks.emplace_back(masks);
+        _maskTiles.emplace_back(maskTiles);
+    }
+
+    if (_maskTiles.size() && _maskTiles[0].size())
+    {
+        float transparent = 0.f, opaque = 0.f;
+        for (auto& tiles : _maskTiles)
+        {
+            transparent += tiles[0].getCoverage(MaskTiles::transparent);
+            opaque += tiles[0].getCoverage(MaskTiles::opaque);
+        }
+        cout << "FilmPlayer: first mask is " << static_cast<int>(transparent * 100.f / _maskTiles.size()) << "% transparent and "
+             << static_cast<int>(opaque * 100.f / _maskTiles.size()) << "% opaque tiles" << endl;
     }
 
     if (_frames.size() && _frames.size() == _frameNbr)
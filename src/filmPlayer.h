@@ -28,6 +28,8 @@
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "./maskTiles.h"
+
 #define PLANE_BASENAME "plan"
 #define FRAME_BASENAME "Frame"
 
@@ -35,7 +37,9 @@
 class FilmPlayer
 {
     public:
-        FilmPlayer(std::string path, int frameNbr, int planeNbr, float fps = 10.f);
+        // If premultiplied is true, each plane with a mask is stored multiplied by it,
+        // which saves this multiplication when compositing
+        FilmPlayer(std::string path, int frameNbr, int planeNbr, float fps = 10.f, bool premultiplied = false);
         ~FilmPlayer();
 
         explicit operator bool() const
@@ -48,7 +52,11 @@ class FilmPlayer
         // Get the current frame based on time and fps. The first one also updates the frameChanged status
         std::vector<cv::Mat>& getCurrentFrame();
         std::vector<cv::Mat>& getCurrentMask() {return _masks[_lastIndex];}
+        std::vector<MaskTiles>& getCurrentMaskTiles() {return _maskTiles[_lastIndex];}
+        // Get the planes of the given frame, the last one being the background
+        std::vector<cv::Mat>& getFrame(int index) {return _frames[index];}
         int getFrameNbr() {return _frameNbr;}
+        bool isPremultiplied() const {return _premultiplied;}
         bool hasChangedFrame();
 
     private:
@@ -56,12 +64,14 @@ class FilmPlayer
         uint32_t _frameNbr {0};
         uint32_t _planeNbr {0};
         float _fps {10.f};
+        bool _premultiplied {false};
 
         bool _ready {false};
         bool _frameChanged {false};
         int _lastIndex {0};
         std::vector<std::vector<cv::Mat>> _frames;
         std::vector<std::vector<cv::Mat>> _masks; // frameNbr - 1 masks total, one between each layer
+        std::vector<std::vector<MaskTiles>> _maskTiles; // Tiles classification for each mask
         std::chrono::milliseconds _startTime;
 };
 
@@ -0,0 +1,43 @@
+#include "framePool.h"
+
+using namespace std;
+
+/*************/
+cv::Mat FramePool::get(cv::Size size, int type)
+{
+    for (auto& buffer : _buffers)
+    {
+        // A reference count of 1 means that only the pool holds this buffer
+        if (buffer.mat.size() == size && buffer.mat.type() == type && buffer.mat.u->refcount == 1)
+        {
+            buffer.lastUsed = _frameIndex;
+            return buffer.mat;
+        }
+    }
+
+    Buffer buffer;
+    buffer.mat = cv::Mat(size, type);
+    buffer.lastUsed = _frameIndex;
+    _buffers.push_back(buffer);
+    _frameAllocations++;
+
+    return buffer.mat;
+}
+
+/*************/
+unsigned int FramePool::newFrame()
+{
+    _frameIndex++;
+
+    for (auto bufferIt = _buffers.begin(); bufferIt != _buffers.end();)
+    {
+        if (bufferIt->mat.u->refcount == 1 && _frameIndex - bufferIt->lastUsed > _maxUnusedFrames)
+            bufferIt = _buffers.erase(bufferIt);
+        else
+            bufferIt++;
+    }
+
+    auto allocations = _frameAllocations;
+    _frameAllocations = 0;
+    return allocations;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*************/
+class FramePool
+{
+    public:
+        // Get a buffer of the given size and type, with an undefined content
+        // It goes back to the pool as soon as no matrix references it anymore
+        cv::Mat get(cv::Size size, int type);
+
+        // Mark the beginning of a new frame, and free the buffers unused for a while
+        // Returns the number of buffers allocated during the previous frame
+        unsigned int newFrame();
+
+        unsigned int getBufferNbr() const {return _buffers.size();}
+
+    private:
+        struct Buffer
+        {
+            cv::Mat mat;
+            uint64_t lastUsed {0};
+        };
+
+        static const uint64_t _maxUnusedFrames = 120;
+
+        std::vector<Buffer> _buffers {};
+        uint64_t _frameIndex {0};
+        unsigned int _frameAllocations {0};
+};
+
+#endif
@@ -0,0 +1,235 @@
+#include "frameRecorder.h"
+
+#include <iostream>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+
+/*************/
+FrameRecorder::FrameRecorder(double scale, unsigned int queueSize)
+{
+    _scale = scale;
+    _queueSize = max(1u, queueSize);
+
+    _thread = thread([&]() {
+        run();
+    });
+}
+
+/*************/
+FrameRecorder::~FrameRecorder()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _itemCondition.notify_all();
+
+    if (_thread.joinable())
+        _thread.join();
+}
+
+/*************/
+void FrameRecorder::setMemoryLimit(size_t limit)
+{
+    lock_guard<mutex> lock(_mutex);
+    _memoryLimit = limit;
+}
+
+/*************/
+void FrameRecorder::push(const cv::Mat& frame, const string& filename)
+{
+    Item item;
+    item.frame = frame;
+    item.filename = filename;
+    enqueue(item);
+}
+
+/*************/
+void FrameRecorder::startGif(const string& filename, shared_ptr<const gif::Histogram> seed, int delay, gif::Dithering dithering)
+{
+    Item item;
+    item.type = Item::Type::startGif;
+    item.filename = filename;
+    item.seed = seed;
+    item.delay = delay;
+    item.dithering = dithering;
+
+    _pendingGifs++;
+    enqueue(item);
+}
+
+/*************/
+void FrameRecorder::finishGif(bool cancel)
+{
+    Item item;
+    item.type = Item::Type::finishGif;
+    item.cancel = cancel;
+    item.time = chrono::high_resolution_clock::now();
+    enqueue(item);
+}
+
+/*************/
+void FrameRecorder::enqueue(const Item& item)
+{
+    {
+        unique_lock<mutex> lock(_mutex);
+        _doneCondition.wait(lock, [&]() {return _queue.size() < _queueSize;});
+        _queue.push_back(item);
+    }
+    _itemCondition.notify_one();
+}
+
+/*************/
+void FrameRecorder::flush()
+{
+    unique_lock<mutex> lock(_mutex);
+    _doneCondition.wait(lock, [&]() {return _queue.size() == 0 && !_writing;});
+}
+
+/*************/
+cv::Mat FrameRecorder::takeFrame(const string& filename)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto frameIt = _frames.find(filename);
+    if (frameIt == _frames.end())
+        return cv::Mat();
+
+    auto frame = frameIt->second;
+    _memoryUsed -= frame.total() * frame.elemSize();
+    _frames.erase(frameIt);
+    return frame;
+}
+
+/*************/
+size_t FrameRecorder::getMemoryUsed()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _memoryUsed;
+}
+
+/*************/
+void FrameRecorder::run()
+{
+    while (true)
+    {
+        Item item;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _itemCondition.wait(lock, [&]() {return _stop || _queue.size() != 0;});
+            // The queue is emptied before stopping, as recorded frames are never dropped
+            if (_queue.size() == 0)
+                return;
+
+            item = _queue.front();
+            _queue.pop_front();
+            _writing = true;
+        }
+        _doneCondition.notify_all();
+
+        if (item.type == Item::Type::startGif)
+            openGif(item);
+        else if (item.type == Item::Type::finishGif)
+            closeGif(item);
+        else
+            recordFrame(item);
+        item = Item(); // The frame goes back to the render thread pool
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            _writing = false;
+        }
+        _doneCondition.notify_all();
+    }
+}
+
+/*************/
+void FrameRecorder::recordFrame(const Item& item)
+{
+    cv::Mat resizedImage;
+    cv::resize(item.frame, resizedImage, cv::Size(), _scale, _scale, cv::INTER_LINEAR);
+
+    if (_gif.encoder)
+    {
+        // The palette is built once the first frame is known
+        bool success = true;
+        if (!_gif.encoder->isOpen())
+        {
+            gif::Histogram histogram = _gif.seed ? *_gif.seed : gif::Histogram();
+            histogram.add(resizedImage);
+            success = _gif.encoder->open(_gif.filename, resizedImage.size(), gif::buildPalette(histogram, 255));
+        }
+
+        if (success && _gif.encoder->addFrame(resizedImage, _gif.delay))
+        {
+            _gif.frameNbr++;
+        }
+        else
+        {
+            cout << "FrameRecorder: could not encode a frame to " << _gif.filename << endl;
+            _failed++;
+        }
+        _written++;
+        return;
+    }
+
+    // Frames go to disk once the memory limit is reached
+    bool keptInMemory = false;
+    {
+        lock_guard<mutex> lock(_mutex);
+        size_t size = resizedImage.total() * resizedImage.elemSize();
+        if (_memoryUsed + size <= _memoryLimit)
+        {
+            _frames[item.filename] = resizedImage;
+            _memoryUsed += size;
+            keptInMemory = true;
+        }
+    }
+
+    if (!keptInMemory && !cv::imwrite(item.filename, resizedImage, {cv::IMWRITE_PNG_COMPRESSION, 9}))
+    {
+        cout << "FrameRecorder: could not write " << item.filename << endl;
+        _failed++;
+    }
+    _written++;
+}
+
+/*************/
+void FrameRecorder::openGif(const Item& item)
+{
+    // A GIF which has not been finished is dropped
+    if (_gif.encoder)
+    {
+        _gif = Gif();
+        _pendingGifs--;
+    }
+
+    _gif.encoder = unique_ptr<GifEncoder>(new GifEncoder());
+    _gif.encoder->setDithering(item.dithering);
+    _gif.filename = item.filename;
+    _gif.seed = item.seed;
+    _gif.delay = item.delay;
+}
+
+/*************/
+void FrameRecorder::closeGif(const Item& item)
+{
+    if (!_gif.encoder)
+        return;
+
+    if (!item.cancel && _gif.encoder->isOpen())
+    {
+        if (_gif.encoder->close())
+        {
+            auto end = chrono::high_resolution_clock::now();
+            cout << "FrameRecorder: wrote " << _gif.frameNbr << " frames to " << _gif.filename << ", "
+                 << chrono::duration_cast<chrono::milliseconds>(end - item.time).count() << " ms after the end of the record" << endl;
+        }
+    }
+
+    // The encoder drops the file if it has not been closed
+    _gif = Gif();
+    _pendingGifs--;
+}
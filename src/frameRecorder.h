@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FRAMERECORDER_H
+#define FRAMERECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <opencv2/core.hpp>
+
+#include "./gifEncoder.h"
+
+/*************/
+// Scales recorded frames from a dedicated thread, so that it does not stall the render loop
+// Frames are either encoded to a GIF as they come, see startGif, or kept in memory as long as
+// they fit in the memory limit, those which do not being written as PNG files
+class FrameRecorder
+{
+    public:
+        FrameRecorder(double scale = 0.5, unsigned int queueSize = 4);
+        // Queued frames are written before returning
+        ~FrameRecorder();
+
+        // Set the memory available to the recorded frames, in bytes. 0 writes all frames to disk
+        void setMemoryLimit(size_t limit);
+
+        // Queue a frame to be recorded, under the given filename if it is written to disk
+        // The frame is referenced, not copied: it should not be modified afterwards
+        // Recorded frames are never dropped, so this waits for the thread if the queue is full
+        void push(const cv::Mat& frame, const std::string& filename);
+
+        // Wait for all queued frames to be recorded
+        void flush();
+
+        // Encode the frames pushed from now on to a GIF file as they are recorded, instead of keeping them
+        // As frames are not known in advance, the global palette is built from the seed histogram and the
+        // first frame. The file is written as frames are encoded
+        // Encoding runs on the recorder thread only, as it is concurrent with compositing
+        void startGif(const std::string& filename, std::shared_ptr<const gif::Histogram> seed, int delay,
+                      gif::Dithering dithering = gif::Dithering::none);
+
+        // Write the end of the GIF once the frames pushed before are encoded, or drop it if cancel is true
+        void finishGif(bool cancel = false);
+
+        // True from startGif until the GIF has been written by finishGif
+        bool isGifPending() const {return _pendingGifs != 0;}
+
+        // Get a frame kept in memory, which frees its memory
+        // Returns an empty matrix if it has been written to disk, or has already been taken
+        cv::Mat takeFrame(const std::string& filename);
+
+        // Frames recorded since the start, in memory or on disk, and frames which could not be written
+        uint64_t getWrittenNbr() const {return _written;}
+        uint64_t getFailedNbr() const {return _failed;}
+        // Memory held by the frames kept in memory, in bytes
+        size_t getMemoryUsed();
+
+    private:
+        struct Item
+        {
+            enum class Type
+            {
+                frame,
+                startGif,
+                finishGif
+            };
+
+            Type type {Type::frame};
+            cv::Mat frame {};
+            std::string filename {""};
+
+            // For startGif and finishGif
+            std::shared_ptr<const gif::Histogram> seed {nullptr};
+            int delay {0};
+            gif::Dithering dithering {gif::Dithering::none};
+            bool cancel {false};
+            std::chrono::high_resolution_clock::time_point time {};
+        };
+
+        // The GIF being encoded, only used by the recorder thread
+        struct Gif
+        {
+            std::unique_ptr<GifEncoder> encoder {nullptr};
+            std::string filename {""};
+            std::shared_ptr<const gif::Histogram> seed {nullptr};
+            int delay {0};
+            unsigned int frameNbr {0};
+        };
+
+        double _scale {0.5};
+        unsigned int _queueSize {4};
+
+        std::thread _thread {};
+        std::mutex _mutex {};
+        std::condition_variable _itemCondition {};
+        std::condition_variable _doneCondition {}; // Room in the queue, or an item written
+        std::deque<Item> _queue {};
+        bool _writing {false};
+        bool _stop {false};
+
+        size_t _memoryLimit {0};
+        size_t _memoryUsed {0};
+        std::map<std::string, cv::Mat> _frames {}; // Frames kept in memory, by filename
+
+        std::atomic<uint64_t> _written {0};
+        std::atomic<uint64_t> _failed {0};
+
+        Gif _gif {};
+        std::atomic<int> _pendingGifs {0};
+
+        void run();
+        void enqueue(const Item& item);
+        void recordFrame(const Item& item);
+        void openGif(const Item& item);
+        void closeGif(const Item& item);
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./outputFormat.h"
+
+/*************/
+// Somewhere to send the composited frames to, already converted to the sink format
+class FrameSink
+{
+    public:
+        virtual ~FrameSink() {}
+
+        virtual explicit operator bool() const = 0;
+
+        // Send a frame by copying it
+        virtual bool writeToDevice(void* data, size_t size) = 0;
+
+        // Get a sink buffer to write the next frame into, of getFrameSize() bytes
+        // If wait is set and no buffer is free, blocks until one is, otherwise returns nullptr
+        // Several buffers can be acquired at once, from different threads, but only one
+        // thread should acquire with wait set. Only streaming sinks have buffers
+        virtual uint8_t* acquireBuffer(bool wait = true) {return nullptr;}
+
+        // Send an acquired buffer
+        virtual bool queueBuffer(const uint8_t* data) {return false;}
+
+        // Give back an acquired buffer without sending it
+        virtual void releaseBuffer(const uint8_t* data) {}
+
+        // True if data is the start of one of the sink buffers
+        virtual bool isDeviceBuffer(const uint8_t* data) const {return false;}
+
+        virtual bool isStreaming() {return false;}
+
+        // True if acquireBuffer can have to wait for the consumer, in which case a buffer is
+        // acquired and given back after each frame from the sink thread, so that it waits there
+        virtual bool needsBufferReclaim() {return false;}
+
+        // Wake up a thread waiting in writeToDevice or acquireBuffer, which then fails, as do
+        // the following waits. Called before destroying a sink whose consumer may be stalled
+        virtual void interrupt() {}
+
+        inline size_t getFrameSize() {return _frameSize;}
+        inline int getWidth() {return _width;}
+        inline int getHeight() {return _height;}
+        inline output::Format getFormat() {return _format;}
+
+    protected:
+        int _width {0};
+        int _height {0};
+        output::Format _format {output::Format::rgb24};
+        size_t _frameSize {0};
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "gifDither.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace gif
+{
+
+/*************/
+// 8x8 Bayer matrix, turned into offsets in [-15, 15] added to each channel
+static const int _bayer[8][8] = {{ 0, 32,  8, 40,  2, 34, 10, 42},
+                                 {48, 16, 56, 24, 50, 18, 58, 26},
+                                 {12, 44,  4, 36, 14, 46,  6, 38},
+                                 {60, 28, 52, 20, 62, 30, 54, 22},
+                                 { 3, 35, 11, 43,  1, 33,  9, 41},
+                                 {51, 19, 59, 27, 49, 17, 57, 25},
+                                 {15, 47,  7, 39, 13, 45,  5, 37},
+                                 {63, 31, 55, 23, 61, 29, 53, 21}};
+
+// Pixels processed by a row between two progress updates, for error diffusion
+static const int _wavefrontChunk = 16;
+
+/*************/
+static inline uint8_t clampByte(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+/*************/
+template<bool Ordered>
+static void mapRows(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices, int firstRow, int lastRow)
+{
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        uint8_t* rowIndices = indices + y * frame.cols;
+
+        int offsets[8];
+        for (int i = 0; i < 8; ++i)
+            offsets[i] = Ordered ? (_bayer[y & 7][i] * 2 - 63) / 4 : 0;
+
+        for (int x = 0; x < frame.cols; ++x)
+        {
+            const uint8_t* pixel = row + x * 3;
+            if (Ordered)
+            {
+                int offset = offsets[x & 7];
+                rowIndices[x] = lut.get(clampByte(pixel[2] + offset), clampByte(pixel[1] + offset), clampByte(pixel[0] + offset));
+            }
+            else
+            {
+                rowIndices[x] = lut.get(pixel[2], pixel[1], pixel[0]);
+            }
+        }
+    }
+}
+
+/*************/
+// Floyd-Steinberg on a single row, errors being stored in sixteenths with one pixel
+// of margin on both sides. The row above must be two pixels ahead, as it sends
+// errors to the pixel below it and to both neighbours of this one
+static void diffuseRow(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices, int y,
+                       const int16_t* errors, int16_t* nextErrors, const atomic<int>* above, atomic<int>& progress)
+{
+    const Palette& palette = lut.getPalette();
+    const uint8_t* row = frame.ptr<uint8_t>(y);
+    uint8_t* rowIndices = indices + y * frame.cols;
+    int carry[3] = {0, 0, 0}; // Error sent to the next pixel of the row, in RGB order
+
+    for (int start = 0; start < frame.cols; start += _wavefrontChunk)
+    {
+        int end = min(start + _wavefrontChunk, frame.cols);
+        if (above)
+        {
+            int needed = min(end + 1, frame.cols);
+            while (above->load(memory_order_acquire) < needed)
+                this_thread::yield();
+        }
+
+        for (int x = start; x < end; ++x)
+        {
+            const uint8_t* pixel = row + x * 3;
+            const int16_t* error = errors + (x + 1) * 3;
+            uint8_t value[3];
+            for (int c = 0; c < 3; ++c)
+                value[c] = clampByte(pixel[2 - c] + ((error[c] + carry[c] + 8) >> 4));
+
+            uint8_t index = lut.get(value[0], value[1], value[2]);
+            rowIndices[x] = index;
+
+            const Color& color = palette[index];
+            int difference[3] = {value[0] - color.r, value[1] - color.g, value[2] - color.b};
+            int16_t* next = nextErrors + (x + 1) * 3;
+            for (int c = 0; c < 3; ++c)
+            {
+                carry[c] = difference[c] * 7;
+                next[c - 3] += difference[c] * 3;
+                next[c] += difference[c] * 5;
+                next[c + 3] += difference[c];
+            }
+        }
+
+        progress.store(end, memory_order_release);
+    }
+}
+
+/*************/
+static void diffuseFrame(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices, WorkerPool* pool)
+{
+    const size_t rowSize = (frame.cols + 2) * 3;
+    vector<int16_t> errors((frame.rows + 1) * rowSize, 0);
+    unique_ptr<atomic<int>[]> progress(new atomic<int>[frame.rows]);
+    for (int y = 0; y < frame.rows; ++y)
+        progress[y].store(0);
+
+    // Each task takes every taskNbr-th row, waiting for the row above when needed
+    // All the tasks run at the same time, as there are as many as threads in the pool
+    unsigned int taskNbr = pool ? pool->getThreadNbr() : 1;
+    auto diffuseRows = [&](unsigned int task) {
+        for (int y = task; y < frame.rows; y += taskNbr)
+            diffuseRow(frame, lut, indices, y, errors.data() + y * rowSize, errors.data() + (y + 1) * rowSize,
+                       y > 0 ? &progress[y - 1] : nullptr, progress[y]);
+    };
+
+    if (pool)
+        pool->run(taskNbr, diffuseRows);
+    else
+        diffuseRows(0);
+}
+
+/*************/
+string getDitheringName(Dithering dithering)
+{
+    switch (dithering)
+    {
+    default:
+    case Dithering::none:
+        return "none";
+    case Dithering::ordered:
+        return "ordered";
+    case Dithering::errorDiffusion:
+        return "diffusion";
+    }
+}
+
+/*************/
+bool getDitheringFromName(const string& name, Dithering& dithering)
+{
+    for (auto candidate : {Dithering::none, Dithering::ordered, Dithering::errorDiffusion})
+    {
+        if (getDitheringName(candidate) == name)
+        {
+            dithering = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*************/
+void mapToPalette(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices, Dithering dithering, WorkerPool* pool)
+{
+    if (frame.type() != CV_8UC3 || lut.getPalette().size() == 0)
+        return;
+
+    if (dithering == Dithering::errorDiffusion)
+    {
+        diffuseFrame(frame, lut, indices, pool);
+        return;
+    }
+
+    auto mapBand = [&](unsigned int band, unsigned int bandNbr) {
+        int firstRow = frame.rows * band / bandNbr;
+        int lastRow = frame.rows * (band + 1) / bandNbr;
+        if (dithering == Dithering::ordered)
+            mapRows<true>(frame, lut, indices, firstRow, lastRow);
+        else
+            mapRows<false>(frame, lut, indices, firstRow, lastRow);
+    };
+
+    if (pool)
+    {
+        unsigned int bandNbr = min<unsigned int>(pool->getThreadNbr() * 2, frame.rows);
+        pool->run(bandNbr, [&](unsigned int band) {
+            mapBand(band, bandNbr);
+        });
+    }
+    else
+    {
+        mapBand(0, 1);
+    }
+}
+
+} // namespace gif
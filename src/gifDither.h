@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFDITHER_H
+#define GIFDITHER_H
+
+#include <cstdint>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "./gifQuantizer.h"
+#include "./workerPool.h"
+
+/*************/
+namespace gif
+{
+    enum class Dithering
+    {
+        none = 0,
+        ordered, // 8x8 Bayer matrix, each pixel being independent from the others
+        errorDiffusion // Floyd-Steinberg
+    };
+
+    std::string getDitheringName(Dithering dithering);
+    bool getDitheringFromName(const std::string& name, Dithering& dithering);
+
+    // Writes the palette index of each pixel of a BGR frame, mapped through the
+    // inverse table and dithered. If a pool is given, the work is shared among its threads:
+    // ordered dithering by bands of rows, error diffusion as a wavefront, each row
+    // starting as soon as the row above is two pixels ahead of it
+    // The result is the same whatever the number of threads
+    void mapToPalette(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices, Dithering dithering, WorkerPool* pool = nullptr);
+}
+
+#endif
@@ -0,0 +1,403 @@
+#include "gifEncoder.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+
+/*************/
+GifEncoder::~GifEncoder()
+{
+    if (_file)
+    {
+        fclose(_file);
+        remove((_filename + ".tmp").c_str());
+    }
+}
+
+/*************/
+bool GifEncoder::open(const string& filename, cv::Size size, int loopCount)
+{
+    _useGlobalPalette = false;
+    _transparentIndex = -1;
+    return writeHeader(filename, size, nullptr, loopCount);
+}
+
+/*************/
+bool GifEncoder::open(const string& filename, cv::Size size, const gif::Palette& palette, int loopCount)
+{
+    if (palette.size() == 0 || palette.size() > 256)
+    {
+        cout << "GifEncoder: a global palette must hold between 1 and 256 colors" << endl;
+        return false;
+    }
+
+    _useGlobalPalette = true;
+    _globalLut = gif::InverseLut(palette);
+    // The first index not used by the palette marks the unchanged pixels
+    _transparentIndex = _deltaEncoding && palette.size() < 256 ? palette.size() : -1;
+    return writeHeader(filename, size, &palette, loopCount);
+}
+
+/*************/
+bool GifEncoder::writeHeader(const string& filename, cv::Size size, const gif::Palette* palette, int loopCount)
+{
+    if (size.width <= 0 || size.height <= 0 || size.width > 0xFFFF || size.height > 0xFFFF)
+    {
+        cout << "GifEncoder: wrong frame size " << size.width << "x" << size.height << endl;
+        return false;
+    }
+
+    // An animation still open is dropped
+    if (_file)
+    {
+        fclose(_file);
+        remove((_filename + ".tmp").c_str());
+        _file = nullptr;
+        _isOpen = false;
+    }
+
+    string tmpFilename = filename + ".tmp";
+    _file = fopen(tmpFilename.c_str(), "wb");
+    if (!_file)
+    {
+        cout << "GifEncoder: unable to write " << tmpFilename << endl;
+        return false;
+    }
+
+    _filename = filename;
+    _size = size;
+    _writeError = false;
+    _data.clear();
+    _indices.resize(size.width * size.height);
+    _previousIndices.clear();
+
+    // Header and logical screen descriptor, followed by the global color table if any
+    const char header[] = "GIF89a";
+    _data.insert(_data.end(), header, header + 6);
+    writeShort(size.width);
+    writeShort(size.height);
+    _data.push_back(palette ? 0x80 | 0x70 | (_tableBits - 1) : 0x00); // Global color table, 8 bits color resolution
+    _data.push_back(0x00); // Background color index
+    _data.push_back(0x00); // No pixel aspect ratio
+    if (palette)
+        writePalette(*palette, _tableBits);
+
+    // Netscape application extension, for looping
+    const char netscape[] = "NETSCAPE2.0";
+    _data.push_back(0x21);
+    _data.push_back(0xFF);
+    _data.push_back(11);
+    _data.insert(_data.end(), netscape, netscape + 11);
+    _data.push_back(3);
+    _data.push_back(1);
+    writeShort(loopCount);
+    _data.push_back(0);
+    flushData();
+
+    _isOpen = true;
+    return true;
+}
+
+/*************/
+bool GifEncoder::addFrame(const cv::Mat& frame, int delay)
+{
+    if (!_isOpen)
+        return false;
+
+    if (frame.size() != _size || frame.type() != CV_8UC3)
+    {
+        cout << "GifEncoder: frames must be BGR and of the size given to open" << endl;
+        return false;
+    }
+
+    _indices.resize(_size.width * _size.height);
+    mapFrame(frame, _indices.data(), _encodedFrame.palette, _workerPool.get());
+
+    bool isDelta = _transparentIndex >= 0 && _previousIndices.size() != 0;
+    compressFrame(_indices.data(), isDelta ? _previousIndices.data() : nullptr, _workspace, _encodedFrame);
+    writeFrame(_encodedFrame, delay);
+
+    flushData();
+
+    if (_transparentIndex >= 0)
+        _previousIndices.swap(_indices);
+    return true;
+}
+
+/*************/
+bool GifEncoder::addFrames(const vector<cv::Mat>& frames, int delay)
+{
+    if (!_isOpen)
+        return false;
+
+    for (auto& frame : frames)
+    {
+        if (frame.size() != _size || frame.type() != CV_8UC3)
+        {
+            cout << "GifEncoder: frames must be BGR and of the size given to open" << endl;
+            return false;
+        }
+    }
+
+    if (frames.size() == 0)
+        return true;
+
+    const size_t frameSize = _size.width * _size.height;
+    vector<uint8_t> indices(frames.size() * frameSize);
+    vector<EncodedFrame> encodedFrames(frames.size());
+
+    // Each thread takes the next frame to encode, with its own workspace
+    unsigned int taskNbr = _workerPool ? _workerPool->getThreadNbr() : 1;
+    vector<Workspace> workspaces(taskNbr);
+    atomic<unsigned int> nextFrame {0};
+    auto runTasks = [&](const function<void(unsigned int, unsigned int)>& work) {
+        nextFrame = 0;
+        auto task = [&](unsigned int taskIndex) {
+            unsigned int frameIndex;
+            while ((frameIndex = nextFrame++) < frames.size())
+                work(taskIndex, frameIndex);
+        };
+
+        if (_workerPool)
+            _workerPool->run(taskNbr, task);
+        else
+            task(0);
+    };
+
+    // All frames are mapped first, as each one is compared to the previous one
+    runTasks([&](unsigned int, unsigned int frameIndex) {
+        mapFrame(frames[frameIndex], indices.data() + frameIndex * frameSize, encodedFrames[frameIndex].palette, nullptr);
+    });
+
+    bool isDelta = _transparentIndex >= 0;
+    runTasks([&](unsigned int taskIndex, unsigned int frameIndex) {
+        const uint8_t* previous = nullptr;
+        if (isDelta && frameIndex > 0)
+            previous = indices.data() + (frameIndex - 1) * frameSize;
+        else if (isDelta && _previousIndices.size() != 0)
+            previous = _previousIndices.data();
+        compressFrame(indices.data() + frameIndex * frameSize, previous, workspaces[taskIndex], encodedFrames[frameIndex]);
+    });
+
+    // Then they are written in order, which is only a copy
+    for (auto& encodedFrame : encodedFrames)
+        writeFrame(encodedFrame, delay);
+    flushData();
+
+    if (isDelta)
+        _previousIndices.assign(indices.end() - frameSize, indices.end());
+    return true;
+}
+
+/*************/
+void GifEncoder::mapFrame(const cv::Mat& frame, uint8_t* indices, gif::Palette& palette, WorkerPool* pool) const
+{
+    if (_useGlobalPalette)
+    {
+        palette.clear();
+        gif::mapToPalette(frame, _globalLut, indices, _dithering, pool);
+    }
+    else
+    {
+        palette = gif::buildPalette(frame, 256);
+        if (_dithering == gif::Dithering::none)
+            gif::mapToPalette(frame, palette, indices);
+        else
+            gif::mapToPalette(frame, gif::InverseLut(palette), indices, _dithering, pool);
+    }
+}
+
+/*************/
+void GifEncoder::compressFrame(const uint8_t* indices, const uint8_t* previous, Workspace& workspace, EncodedFrame& encodedFrame) const
+{
+    // Only the part which changed since the previous frame is written, the rest being kept
+    // as it is by the decoder as frames are not disposed
+    cv::Rect rect(0, 0, _size.width, _size.height);
+    const uint8_t* data = indices;
+    encodedFrame.isDelta = previous != nullptr;
+    if (encodedFrame.isDelta)
+    {
+        rect = getChangedRect(indices, previous);
+        if (rect.area() == 0)
+            rect = cv::Rect(0, 0, 1, 1); // Nothing changed, a single transparent pixel is enough
+
+        workspace.deltaIndices.resize(rect.area());
+        uint8_t* delta = workspace.deltaIndices.data();
+        for (int y = rect.y; y < rect.y + rect.height; ++y)
+        {
+            const uint8_t* currentRow = indices + y * _size.width;
+            const uint8_t* previousRow = previous + y * _size.width;
+            for (int x = rect.x; x < rect.x + rect.width; ++x)
+                *delta++ = currentRow[x] == previousRow[x] ? _transparentIndex : currentRow[x];
+        }
+        data = workspace.deltaIndices.data();
+    }
+
+    encodedFrame.rect = rect;
+    encodedFrame.imageData.clear();
+    workspace.lzw.compress(data, rect.area(), _tableBits, encodedFrame.imageData);
+}
+
+/*************/
+void GifEncoder::writeFrame(const EncodedFrame& encodedFrame, int delay)
+{
+    // Graphic control extension, for the delay and the transparency
+    _data.push_back(0x21);
+    _data.push_back(0xF9);
+    _data.push_back(4);
+    _data.push_back(encodedFrame.isDelta ? 0x05 : 0x04); // Do not dispose, transparency if delta encoded
+    writeShort(delay);
+    _data.push_back(encodedFrame.isDelta ? _transparentIndex : 0);
+    _data.push_back(0);
+
+    // Image descriptor, with a local color table if there is no global one
+    const cv::Rect& rect = encodedFrame.rect;
+    _data.push_back(0x2C);
+    writeShort(rect.x);
+    writeShort(rect.y);
+    writeShort(rect.width);
+    writeShort(rect.height);
+    if (_useGlobalPalette)
+    {
+        _data.push_back(0x00);
+    }
+    else
+    {
+        _data.push_back(0x80 | (_tableBits - 1));
+        writePalette(encodedFrame.palette, _tableBits);
+    }
+
+    _data.insert(_data.end(), encodedFrame.imageData.begin(), encodedFrame.imageData.end());
+}
+
+/*************/
+cv::Rect GifEncoder::getChangedRect(const uint8_t* indices, const uint8_t* previous) const
+{
+    int minX = _size.width;
+    int maxX = -1;
+    int minY = -1;
+    int maxY = -1;
+
+    for (int y = 0; y < _size.height; ++y)
+    {
+        const uint8_t* currentRow = indices + y * _size.width;
+        const uint8_t* previousRow = previous + y * _size.width;
+        if (memcmp(currentRow, previousRow, _size.width) == 0)
+            continue;
+
+        if (minY < 0)
+            minY = y;
+        maxY = y;
+
+        // Only the columns outside of the rectangle found so far are searched
+        int x = 0;
+        while (x < minX && currentRow[x] == previousRow[x])
+            ++x;
+        minX = min(minX, x);
+
+        x = _size.width - 1;
+        while (x > maxX && currentRow[x] == previousRow[x])
+            --x;
+        maxX = max(maxX, x);
+    }
+
+    if (minY < 0)
+        return cv::Rect();
+    return cv::Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+}
+
+/*************/
+bool GifEncoder::close()
+{
+    if (!_isOpen)
+        return false;
+    _isOpen = false;
+
+    _data.push_back(0x3B); // Trailer
+    flushData();
+
+    string tmpFilename = _filename + ".tmp";
+    bool success = !_writeError;
+    success &= fclose(_file) == 0;
+    _file = nullptr;
+    success &= success && rename(tmpFilename.c_str(), _filename.c_str()) == 0;
+    if (!success)
+    {
+        cout << "GifEncoder: error while writing " << _filename << endl;
+        remove(tmpFilename.c_str());
+    }
+
+    _data.clear();
+    _data.shrink_to_fit();
+    return success;
+}
+
+/*************/
+void GifEncoder::flushData()
+{
+    if (_file && _data.size() != 0)
+        _writeError |= fwrite(_data.data(), 1, _data.size(), _file) != _data.size();
+    _data.clear();
+}
+
+/*************/
+void GifEncoder::setThreadNbr(unsigned int threadNbr)
+{
+    if (threadNbr == 0)
+        threadNbr = max(1u, thread::hardware_concurrency());
+
+    if (threadNbr == 1)
+        _workerPool.reset();
+    else if (!_workerPool || _workerPool->getThreadNbr() != threadNbr)
+        _workerPool = unique_ptr<WorkerPool>(new WorkerPool(threadNbr));
+}
+
+/*************/
+bool GifEncoder::encode(const vector<cv::Mat>& frames, const string& filename, int delay, gif::Dithering dithering, unsigned int threadNbr)
+{
+    if (frames.size() == 0)
+        return false;
+
+    // Recordings are short and from a single scene, so one palette fits them all.
+    // This saves a color table per frame, and the mapping goes through a lookup table
+    gif::Histogram histogram;
+    for (auto& frame : frames)
+        histogram.add(frame, _histogramStep);
+    GifEncoder encoder;
+    // One color is left for the transparent pixels of delta encoded frames
+    auto palette = gif::buildPalette(histogram, encoder._deltaEncoding ? 255 : 256);
+
+    encoder.setDithering(dithering);
+    encoder.setThreadNbr(threadNbr);
+    if (!encoder.open(filename, frames[0].size(), palette))
+        return false;
+
+    if (!encoder.addFrames(frames, delay))
+        return false;
+
+    return encoder.close();
+}
+
+/*************/
+void GifEncoder::writeShort(uint16_t value)
+{
+    _data.push_back(value & 0xFF);
+    _data.push_back(value >> 8);
+}
+
+/*************/
+void GifEncoder::writePalette(const gif::Palette& palette, int tableBits)
+{
+    for (int i = 0; i < (1 << tableBits); ++i)
+    {
+        gif::Color color = i < static_cast<int>(palette.size()) ? palette[i] : gif::Color {0, 0, 0};
+        _data.push_back(color.r);
+        _data.push_back(color.g);
+        _data.push_back(color.b);
+    }
+}
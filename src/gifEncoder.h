@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFENCODER_H
+#define GIFENCODER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "./gifDither.h"
+#include "./gifLzw.h"
+#include "./gifQuantizer.h"
+#include "./workerPool.h"
+
+/*************/
+// Writes animated GIF89a files from BGR frames, either with a palette per frame
+// or with a global palette shared by all of them
+class GifEncoder
+{
+    public:
+        GifEncoder() {}
+        // An animation which has not been closed is dropped
+        ~GifEncoder();
+
+        // Start a new animation of the given size, looping forever if loopCount is 0
+        // Each frame gets its own palette, built from its colors
+        bool open(const std::string& filename, cv::Size size, int loopCount = 0);
+
+        // Same as above, all frames being mapped to the given global palette
+        // If delta encoding is enabled and the palette leaves an index free, each frame only holds
+        // the rectangle which changed since the previous one, unchanged pixels being transparent
+        bool open(const std::string& filename, cv::Size size, const gif::Palette& palette, int loopCount = 0);
+
+        // Add a BGR frame of the size given to open, shown for delay hundredths of a second
+        bool addFrame(const cv::Mat& frame, int delay);
+
+        // Same as above for several frames at once. The frames are mapped and compressed
+        // in parallel, one per thread, then written in order
+        bool addFrames(const std::vector<cv::Mat>& frames, int delay);
+
+        // Finish the file. It is written next to its destination as frames are added,
+        // then renamed, so that a partly written animation is never seen
+        bool close();
+
+        bool isOpen() const {return _isOpen;}
+
+        // Dithering applied when mapping the frames to their palette, none by default
+        void setDithering(gif::Dithering dithering) {_dithering = dithering;}
+
+        // Enable delta encoding against the previous frame, enabled by default
+        // It applies to the next call to open, and needs a global palette
+        void setDeltaEncoding(bool enabled) {_deltaEncoding = enabled;}
+
+        // Set the number of threads encoding the frames given to addFrames, and dithering
+        // those given to addFrame, 0 to use all cores. The file is the same whatever the number of threads
+        void setThreadNbr(unsigned int threadNbr);
+
+        // Encode a whole sequence at once, with a global palette built from all frames
+        static bool encode(const std::vector<cv::Mat>& frames, const std::string& filename, int delay,
+                           gif::Dithering dithering = gif::Dithering::none, unsigned int threadNbr = 1);
+
+    private:
+        std::string _filename {""};
+        cv::Size _size {0, 0};
+        bool _isOpen {false};
+
+        bool _useGlobalPalette {false};
+        gif::InverseLut _globalLut {};
+
+        // A frame ready to be written, see compressFrame
+        struct EncodedFrame
+        {
+            cv::Rect rect {};
+            bool isDelta {false};
+            gif::Palette palette {}; // Local color table, empty with a global palette
+            std::vector<uint8_t> imageData {}; // LZW compressed, as data sub-blocks
+        };
+
+        // Buffers used to compress a frame, one set per thread
+        struct Workspace
+        {
+            gif::LzwEncoder lzw {};
+            std::vector<uint8_t> deltaIndices {};
+        };
+
+        bool _deltaEncoding {true};
+        int _transparentIndex {-1}; // Set if frames are delta encoded
+        std::vector<uint8_t> _previousIndices {}; // Empty before the first frame
+
+        gif::Dithering _dithering {gif::Dithering::none};
+        std::unique_ptr<WorkerPool> _workerPool {nullptr};
+
+        FILE* _file {nullptr};
+        bool _writeError {false};
+        std::vector<uint8_t> _data {}; // Written to the file after each frame
+        std::vector<uint8_t> _indices {}; // Palette indices of the current frame, for addFrame
+        EncodedFrame _encodedFrame {};
+        Workspace _workspace {};
+
+        static const int _tableBits = 8;
+        static const int _histogramStep = 2; // Pixels skipped when building the global palette
+
+        bool writeHeader(const std::string& filename, cv::Size size, const gif::Palette* palette, int loopCount);
+        // Write the data added since the last call to the file
+        void flushData();
+
+        // Map a frame to palette indices, and build its palette if there is no global one
+        void mapFrame(const cv::Mat& frame, uint8_t* indices, gif::Palette& palette, WorkerPool* pool) const;
+        // Compress the indices, as a delta against the previous ones if not null
+        // The encoder itself is not modified, so that frames can be compressed in parallel
+        void compressFrame(const uint8_t* indices, const uint8_t* previous, Workspace& workspace, EncodedFrame& encodedFrame) const;
+        void writeFrame(const EncodedFrame& encodedFrame, int delay);
+
+        // Bounding rectangle of the pixels which differ from the previous frame, empty if none
+        cv::Rect getChangedRect(const uint8_t* indices, const uint8_t* previous) const;
+
+        void writeShort(uint16_t value);
+        void writePalette(const gif::Palette& palette, int tableBits);
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "gifLzw.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+namespace gif
+{
+
+/*************/
+static inline uint32_t hashKey(uint32_t key, int bits)
+{
+    return (key * 2654435761u) >> (32 - bits);
+}
+
+/*************/
+static inline void storeWord(uint8_t* dst, uint32_t word)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(dst, &word, 4);
+#else
+    dst[0] = word;
+    dst[1] = word >> 8;
+    dst[2] = word >> 16;
+    dst[3] = word >> 24;
+#endif
+}
+
+/*************/
+void LzwEncoder::compress(const uint8_t* indices, size_t count, int minCodeSize, vector<uint8_t>& data)
+{
+    const uint32_t tableMask = (1 << _tableBits) - 1;
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+
+    _keys.assign(1 << _tableBits, 0);
+    _codes.resize(1 << _tableBits);
+
+    // At most one code per index, plus the clear codes and the end code, of at most 12 bits,
+    // and room for the last word to be written whole
+    size_t maxCodes = count + count / (_maxCode - endCode - 1) + 3;
+    _bytes.resize(maxCodes * 12 / 8 + 8);
+    uint8_t* out = _bytes.data();
+
+    // Codes are packed from the least significant bit
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+    int codeSize = minCodeSize + 1;
+
+    auto writeCode = [&](uint32_t code) {
+        bitBuffer |= static_cast<uint64_t>(code) << bitCount;
+        bitCount += codeSize;
+        if (bitCount >= 32)
+        {
+            storeWord(out, bitBuffer);
+            out += 4;
+            bitBuffer >>= 32;
+            bitCount -= 32;
+        }
+    };
+
+    int nextCode = endCode + 1;
+
+    writeCode(clearCode);
+    if (count != 0)
+    {
+        uint32_t prefix = indices[0];
+        for (size_t i = 1; i < count; ++i)
+        {
+            uint32_t key = ((prefix << 8) | indices[i]) + 1;
+            uint32_t slot = hashKey(key, _tableBits);
+            uint32_t stored;
+            while ((stored = _keys[slot]) != 0 && stored != key)
+                slot = (slot + 1) & tableMask;
+
+            if (stored == key)
+            {
+                prefix = _codes[slot];
+                continue;
+            }
+
+            writeCode(prefix);
+
+            // The decoder grows its code size one entry later than we add them,
+            // so the size is checked before adding the new entry
+            if (nextCode < _maxCode)
+            {
+                if (nextCode >= (1 << codeSize))
+                    codeSize++;
+                _keys[slot] = key;
+                _codes[slot] = nextCode++;
+            }
+            else
+            {
+                writeCode(clearCode);
+                fill(_keys.begin(), _keys.end(), 0);
+                nextCode = endCode + 1;
+                codeSize = minCodeSize + 1;
+            }
+
+            prefix = indices[i];
+        }
+
+        writeCode(prefix);
+        if (nextCode >= (1 << codeSize) && codeSize < 12)
+            codeSize++;
+    }
+    writeCode(endCode);
+
+    while (bitCount > 0)
+    {
+        *out++ = bitBuffer & 0xFF;
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+
+    // Sub-blocks of at most 255 bytes, each preceded by its size
+    size_t size = out - _bytes.data();
+    data.reserve(data.size() + size + size / 255 + 3);
+    data.push_back(minCodeSize);
+    for (size_t offset = 0; offset < size; offset += 255)
+    {
+        size_t blockSize = min<size_t>(255, size - offset);
+        data.push_back(blockSize);
+        data.insert(data.end(), _bytes.data() + offset, _bytes.data() + offset + blockSize);
+    }
+    data.push_back(0); // Block terminator
+}
+
+} // namespace gif
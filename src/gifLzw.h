@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFLZW_H
+#define GIFLZW_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*************/
+namespace gif
+{
+    // LZW compressor for GIF image data. The dictionary is an open addressing hash
+    // table of (prefix code, suffix index) pairs, and codes are packed 32 bits at a time
+    // Its buffers are kept from one call to the next, so one should be reused for all frames
+    class LzwEncoder
+    {
+        public:
+            // Compress the indices, all below 1 << minCodeSize, and append them to data
+            // as GIF image data: the minimum code size followed by data sub-blocks
+            void compress(const uint8_t* indices, size_t count, int minCodeSize, std::vector<uint8_t>& data);
+
+        private:
+            static const int _maxCode = 4096;
+            static const int _tableBits = 13; // Twice the number of codes, so that probes stay short
+
+            std::vector<uint32_t> _keys {}; // (prefix << 8 | suffix) + 1, 0 for empty slots
+            std::vector<uint16_t> _codes {};
+            std::vector<uint8_t> _bytes {}; // Packed codes, before being split in sub-blocks
+    };
+}
+
+#endif
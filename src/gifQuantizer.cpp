@@ -0,0 +1,251 @@
+#include "gifQuantizer.h"
+
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace gif
+{
+
+/*************/
+// A histogram bin, key holding the 5 bits red, green and blue values
+struct Bin
+{
+    uint16_t key;
+    uint64_t count;
+    uint64_t sum[3]; // Red, green and blue, at full precision
+};
+
+/*************/
+static inline int getComponent(uint16_t key, int axis)
+{
+    return (key >> (10 - axis * 5)) & 0x1F;
+}
+
+/*************/
+struct Box
+{
+    size_t begin;
+    size_t end;
+    uint64_t count;
+    int axis; // Longest one
+    int range; // Along the longest axis
+};
+
+/*************/
+static Box makeBox(const vector<Bin>& bins, size_t begin, size_t end)
+{
+    Box box {begin, end, 0, 0, 0};
+    int minimum[3] = {31, 31, 31};
+    int maximum[3] = {0, 0, 0};
+    for (size_t i = begin; i < end; ++i)
+    {
+        box.count += bins[i].count;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            int value = getComponent(bins[i].key, axis);
+            minimum[axis] = min(minimum[axis], value);
+            maximum[axis] = max(maximum[axis], value);
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (maximum[axis] - minimum[axis] > box.range)
+        {
+            box.range = maximum[axis] - minimum[axis];
+            box.axis = axis;
+        }
+    }
+
+    return box;
+}
+
+/*************/
+Histogram::Histogram()
+{
+    _counts.resize(binNbr, 0);
+    _sums.resize(binNbr * 3, 0);
+}
+
+/*************/
+void Histogram::add(const cv::Mat& frame, int step)
+{
+    if (frame.type() != CV_8UC3)
+        return;
+
+    step = max(1, step);
+    for (int y = 0; y < frame.rows; y += step)
+    {
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        for (int x = 0; x < frame.cols; x += step)
+        {
+            const uint8_t* pixel = row + x * 3;
+            int bin = ((pixel[2] >> 3) << 10) | ((pixel[1] >> 3) << 5) | (pixel[0] >> 3);
+            _counts[bin]++;
+            _sums[bin * 3 + 0] += pixel[2];
+            _sums[bin * 3 + 1] += pixel[1];
+            _sums[bin * 3 + 2] += pixel[0];
+        }
+    }
+}
+
+/*************/
+InverseLut::InverseLut(const Palette& palette)
+    : _palette(palette)
+{
+    _table.resize(Histogram::binNbr, 0);
+    if (palette.size() == 0)
+        return;
+
+    for (int bin = 0; bin < Histogram::binNbr; ++bin)
+    {
+        int r = ((bin >> 10) << 3) + 4;
+        int g = (((bin >> 5) & 0x1F) << 3) + 4;
+        int b = ((bin & 0x1F) << 3) + 4;
+
+        int bestDistance = numeric_limits<int>::max();
+        for (unsigned int i = 0; i < palette.size(); ++i)
+        {
+            int dr = palette[i].r - r;
+            int dg = palette[i].g - g;
+            int db = palette[i].b - b;
+            int distance = dr * dr + dg * dg + db * db;
+            if (distance < bestDistance)
+            {
+                bestDistance = distance;
+                _table[bin] = i;
+            }
+        }
+    }
+}
+
+/*************/
+Palette buildPalette(const cv::Mat& frame, int maxColors)
+{
+    Histogram histogram;
+    histogram.add(frame);
+    return buildPalette(histogram, maxColors);
+}
+
+/*************/
+Palette buildPalette(const Histogram& histogram, int maxColors)
+{
+    vector<Bin> bins;
+    for (int i = 0; i < Histogram::binNbr; ++i)
+        if (histogram.getCount(i) != 0)
+            bins.push_back(Bin {static_cast<uint16_t>(i), histogram.getCount(i), {histogram.getSum(i, 0), histogram.getSum(i, 1), histogram.getSum(i, 2)}});
+
+    Palette palette;
+    if (bins.size() == 0)
+        return palette;
+
+    // Split the most populated and widest box at its median, until there are enough boxes
+    vector<Box> boxes {makeBox(bins, 0, bins.size())};
+    while (boxes.size() < static_cast<size_t>(maxColors))
+    {
+        int selected = -1;
+        uint64_t bestScore = 0;
+        for (unsigned int i = 0; i < boxes.size(); ++i)
+        {
+            uint64_t score = boxes[i].count * boxes[i].range;
+            if (boxes[i].end - boxes[i].begin > 1 && score > bestScore)
+            {
+                bestScore = score;
+                selected = i;
+            }
+        }
+
+        if (selected < 0)
+            break;
+
+        Box box = boxes[selected];
+        int axis = box.axis;
+        sort(bins.begin() + box.begin, bins.begin() + box.end, [axis](const Bin& a, const Bin& b) {
+            return getComponent(a.key, axis) < getComponent(b.key, axis);
+        });
+
+        uint64_t half = box.count / 2;
+        uint64_t count = 0;
+        size_t split = box.begin + 1;
+        for (size_t i = box.begin; i < box.end - 1; ++i)
+        {
+            count += bins[i].count;
+            split = i + 1;
+            if (count >= half)
+                break;
+        }
+
+        boxes[selected] = makeBox(bins, box.begin, split);
+        boxes.push_back(makeBox(bins, split, box.end));
+    }
+
+    // Each color is the mean of the pixels in its box
+    for (auto& box : boxes)
+    {
+        uint64_t sum[3] = {0, 0, 0};
+        for (size_t i = box.begin; i < box.end; ++i)
+            for (int c = 0; c < 3; ++c)
+                sum[c] += bins[i].sum[c];
+
+        palette.push_back(Color {static_cast<uint8_t>((sum[0] + box.count / 2) / box.count),
+                                 static_cast<uint8_t>((sum[1] + box.count / 2) / box.count),
+                                 static_cast<uint8_t>((sum[2] + box.count / 2) / box.count)});
+    }
+
+    return palette;
+}
+
+/*************/
+void mapToPalette(const cv::Mat& frame, const Palette& palette, uint8_t* indices)
+{
+    if (palette.size() == 0)
+        return;
+
+    // Consecutive pixels often have the same color, so the last match is kept
+    int lastColor = -1;
+    uint8_t lastIndex = 0;
+
+    for (int y = 0; y < frame.rows; ++y)
+    {
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        for (int x = 0; x < frame.cols; ++x)
+        {
+            const uint8_t* pixel = row + x * 3;
+            int color = (pixel[2] << 16) | (pixel[1] << 8) | pixel[0];
+            if (color != lastColor)
+            {
+                int bestDistance = numeric_limits<int>::max();
+                for (unsigned int i = 0; i < palette.size(); ++i)
+                {
+                    int dr = palette[i].r - pixel[2];
+                    int dg = palette[i].g - pixel[1];
+                    int db = palette[i].b - pixel[0];
+                    int distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        lastIndex = i;
+                    }
+                }
+                lastColor = color;
+            }
+
+            *indices++ = lastIndex;
+        }
+    }
+}
+
+/*************/
+void mapToPalette(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices)
+{
+    for (int y = 0; y < frame.rows; ++y)
+    {
+        const uint8_t* row = frame.ptr<uint8_t>(y);
+        for (int x = 0; x < frame.cols; ++x)
+            *indices++ = lut.get(row[x * 3 + 2], row[x * 3 + 1], row[x * 3]);
+    }
+}
+
+} // namespace gif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFQUANTIZER_H
+#define GIFQUANTIZER_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*************/
+namespace gif
+{
+    struct Color
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    typedef std::vector<Color> Palette;
+
+    // Color histogram at 5 bits per channel, bins being indexed by (r << 10) | (g << 5) | b
+    class Histogram
+    {
+        public:
+            static const int binNbr = 1 << 15;
+
+            Histogram();
+
+            // Add the pixels of a BGR frame, one out of step along both axes
+            void add(const cv::Mat& frame, int step = 1);
+
+            uint64_t getCount(int bin) const {return _counts[bin];}
+            // Sum of the full precision values in a bin, channel being 0 for red, 1 for green and 2 for blue
+            uint64_t getSum(int bin, int channel) const {return _sums[bin * 3 + channel];}
+
+        private:
+            std::vector<uint64_t> _counts;
+            std::vector<uint64_t> _sums;
+    };
+
+    // Maps colors to the nearest palette entry through a table of 32x32x32 cells,
+    // each one holding the entry nearest to its center
+    class InverseLut
+    {
+        public:
+            InverseLut() {}
+            InverseLut(const Palette& palette);
+
+            uint8_t get(uint8_t r, uint8_t g, uint8_t b) const {return _table[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];}
+            const Palette& getPalette() const {return _palette;}
+
+        private:
+            Palette _palette {};
+            std::vector<uint8_t> _table {};
+    };
+
+    // Builds a palette of at most maxColors colors by median cut over a histogram
+    Palette buildPalette(const Histogram& histogram, int maxColors = 256);
+
+    // Same as above, from the histogram of a single BGR frame
+    Palette buildPalette(const cv::Mat& frame, int maxColors = 256);
+
+    // Writes the index of the nearest palette color for each pixel of a BGR frame
+    void mapToPalette(const cv::Mat& frame, const Palette& palette, uint8_t* indices);
+
+    // Same as above through an inverse table, which is much faster but only as
+    // precise as the 5 bits per channel cells of the table
+    void mapToPalette(const cv::Mat& frame, const InverseLut& lut, uint8_t* indices);
+}
+
+#endif
@@ -36,6 +36,17 @@ void GifBox::parseArguments(int argc, char** argv)
         cout << "  -fps: set the framerate" << endl;
         cout << "  -maxRecordTime: set the maximum number of frames recorded" << endl;
         cout << "  -out: set the output v4l2 device, defaults to 0" << endl;
+        cout << "  -outFormat: set the output pixel format, among rgb24, bgr24, yuyv and i420, defaults to rgb24" << endl;
+        cout << "  -mmap: send frames to the v4l2 device through mmap'd buffers instead of write()" << endl;
+        cout << "  -addOut: add an output v4l2 device, as DEVICE[:WIDTHxHEIGHT[:FORMAT]], can be repeated" << endl;
+        cout << "  -addShm: add a shared memory output, as NAME[:WIDTHxHEIGHT[:FORMAT]], can be repeated" << endl;
+        cout << "  -outQueue: set the number of frames waiting to be sent to the v4l2 device, defaults to 2" << endl;
+        cout << "  -outPolicy: set what to do when this queue is full, among dropOldest, dropNewest and block, defaults to dropOldest" << endl;
+        cout << "  -threads: set the number of compositing threads, 0 to use all cores, defaults to 1" << endl;
+        cout << "  -recordMemory: set the memory for the recorded frames in MB, beyond which they are written to disk, 0 to always use the disk, defaults to 64, not used with -gifIncremental" << endl;
+        cout << "  -gifThreads: set the number of threads encoding the recorded GIFs, 0 to use all cores, defaults to 0, not used with -gifIncremental" << endl;
+        cout << "  -gifIncremental: encode the recorded GIFs while recording, with a palette seeded from the film, instead of from all frames once the record ends" << endl;
+        cout << "  -dither: set the dithering of the recorded GIFs, among none, ordered and diffusion, defaults to none" << endl;
         exit(0);
     }
     for (int i = 1; i < argc;)
@@ -70,6 +81,74 @@ void GifBox::parseArguments(int argc, char** argv)
             _state.camOut = stoi(argv[i + 1]);
             ++i;
         }
+        else if ("-outFormat" == string(argv[i]) && i < argc - 1)
+        {
+            if (!output::getFormatFromName(argv[i + 1], _state.outFormat))
+                cout << "Unknown output format: " << argv[i + 1] << ", using " << output::getFormatName(_state.outFormat) << endl;
+            ++i;
+        }
+        else if ("-threads" == string(argv[i]) && i < argc - 1)
+        {
+            _state.threads = max(0, stoi(argv[i + 1]));
+            ++i;
+        }
+        else if ("-recordMemory" == string(argv[i]) && i < argc - 1)
+        {
+            _state.recordMemory = max(0, stoi(argv[i + 1]));
+            ++i;
+        }
+        else if ("-gifThreads" == string(argv[i]) && i < argc - 1)
+        {
+            _state.gifThreads = max(0, stoi(argv[i + 1]));
+            ++i;
+        }
+        else if ("-gifIncremental" == string(argv[i]))
+        {
+            _state.gifIncremental = true;
+        }
+        else if ("-dither" == string(argv[i]) && i < argc - 1)
+        {
+            if (!gif::getDitheringFromName(argv[i + 1], _state.gifDithering))
+                cout << "Unknown dithering: " << argv[i + 1] << ", using " << gif::getDitheringName(_state.gifDithering) << endl;
+            ++i;
+        }
+        else if ("-addOut" == string(argv[i]) && i < argc - 1)
+        {
+            // DEVICE[:WIDTHxHEIGHT[:FORMAT]]
+            OutputSpec spec;
+            string arg = argv[i + 1];
+            auto separator = arg.find(':');
+            spec.device = stoi(arg.substr(0, separator));
+            parseOutputSpec(separator == string::npos ? "" : arg.substr(separator + 1), spec);
+            _state.extraOutputs.push_back(spec);
+            ++i;
+        }
+        else if ("-addShm" == string(argv[i]) && i < argc - 1)
+        {
+            // NAME[:WIDTHxHEIGHT[:FORMAT]]
+            OutputSpec spec;
+            string arg = argv[i + 1];
+            auto separator = arg.find(':');
+            spec.shmName = arg.substr(0, separator);
+            parseOutputSpec(separator == string::npos ? "" : arg.substr(separator + 1), spec);
+            _state.extraOutputs.push_back(spec);
+            ++i;
+        }
+        else if ("-outQueue" == string(argv[i]) && i < argc - 1)
+        {
+            _state.outQueueSize = max(1, stoi(argv[i + 1]));
+            ++i;
+        }
+        else if ("-outPolicy" == string(argv[i]) && i < argc - 1)
+        {
+            if (!AsyncOutput::getPolicyFromName(argv[i + 1], _state.outPolicy))
+                cout << "Unknown output policy: " << argv[i + 1] << ", using " << AsyncOutput::getPolicyName(_state.outPolicy) << endl;
+            ++i;
+        }
+        else if ("-mmap" == string(argv[i]))
+        {
+            _state.outMmap = true;
+        }
         else if ("-hide" == string(argv[i]))
         {
             _state.show = false;
@@ -83,6 +162,25 @@ void GifBox::parseArguments(int argc, char** argv)
     }
 }
 
+/*************/
+void GifBox::parseOutputSpec(const string& arg, OutputSpec& spec)
+{
+    spec.format = _state.outFormat;
+    if (arg.empty())
+        return;
+
+    auto formatStart = arg.find(':');
+    auto size = arg.substr(0, formatStart);
+    auto separator = size.find('x');
+    if (separator != string::npos)
+        spec.size = cv::Size(stoi(size.substr(0, separator)), stoi(size.substr(separator + 1)));
+    else
+        cout << "Wrong output size: " << size << ", using the composited frame size" << endl;
+
+    if (formatStart != string::npos && !output::getFormatFromName(arg.substr(formatStart + 1), spec.format))
+        cout << "Unknown output format: " << arg.substr(formatStart + 1) << ", using " << output::getFormatName(spec.format) << endl;
+}
+
 /*************/
 GifBox::GifBox(int argc, char** argv)
 {
@@ -95,7 +193,7 @@ GifBox::GifBox(int argc, char** argv)
     });
 
     // Load films
-    _films.emplace_back("./films/" + _state.currentFilm + "/", _state.frameNbr, 2, _state.fps);
+    _films.emplace_back("./films/" + _state.currentFilm + "/", _state.frameNbr, 2, _state.fps, true);
     for (auto filmIt = _films.begin(); filmIt != _films.end();)
     {
         auto film = *filmIt;
@@ -115,11 +213,114 @@ GifBox::GifBox(int argc, char** argv)
 
     // And the layer merger
     _layerMerger = unique_ptr<LayerMerger>(new LayerMerger());
+    _layerMerger->setThreadNbr(_state.threads);
+    _layerMerger->setGifDithering(_state.gifDithering);
+    _layerMerger->setGifThreadNbr(_state.gifThreads);
+    _layerMerger->setGifIncremental(_state.gifIncremental);
+    seedGifPalette();
+    _layerMerger->setRecordMemoryLimit(static_cast<size_t>(_state.recordMemory) * 1024 * 1024);
+    _layerMerger->setOutput(true, _state.outFormat);
+
+    // Outputs are opened once the frame size is known
+    OutputSpec mainOutput;
+    mainOutput.device = _state.camOut;
+    mainOutput.format = _state.outFormat;
+    _outputs.resize(1 + _state.extraOutputs.size());
+    _outputs[0].spec = mainOutput;
+    for (unsigned int i = 0; i < _state.extraOutputs.size(); ++i)
+        _outputs[i + 1].spec = _state.extraOutputs[i];
+
+    // Flash the borders of the image when a frame is recorded
+    _flash = make_shared<FlashOverlay>(_state.flashMargin);
+    _layerMerger->addOverlay(_flash, LayerMerger::OverlayStage::live);
 }
 
 /*************/
 GifBox::~GifBox()
 {
+    logOutputStats();
+}
+
+/*************/
+void GifBox::logOutputStats()
+{
+    for (auto& output : _outputs)
+    {
+        if (!output.sink)
+            continue;
+
+        auto stats = output.sink->getStats();
+        auto name = output.spec.shmName.empty() ? "/dev/video" + to_string(output.spec.device) : "shared memory /" + output.spec.shmName;
+        cout << "Output " << name << ": " << stats.written << " frames sent, " << stats.dropped << " dropped, " << stats.errors
+             << " error(s), " << stats.queued << " queued, write time " << stats.meanWriteTime << " ms on average and " << stats.maxWriteTime << " ms at most"
+             << endl;
+    }
+}
+
+/*************/
+void GifBox::sendToOutputs(const cv::Mat& finalImage, uint8_t* deviceBuffer)
+{
+    _outputPyramid.setFrame(finalImage);
+
+    for (unsigned int i = 0; i < _outputs.size(); ++i)
+    {
+        auto& output = _outputs[i];
+        auto size = output.spec.size.area() == 0 ? finalImage.size() : output.spec.size;
+
+        bool resized = !output.sink || size.height != output.sink->getHeight() || size.width != output.sink->getWidth();
+
+        // The merger already converted the frame to the format of the first output. If it did so
+        // in a buffer of a sink about to be recreated, the buffer is unmapped with it and the frame
+        // is converted again, which only happens once per size change
+        cv::Mat outputFrame;
+        if (i == 0 && size == finalImage.size() && !(resized && deviceBuffer))
+            outputFrame = _layerMerger->getOutputFrame();
+
+        if (i == 0 && deviceBuffer && outputFrame.data != deviceBuffer)
+        {
+            output.sink->releaseBuffer(deviceBuffer);
+            deviceBuffer = nullptr;
+        }
+
+        if (resized)
+        {
+            if (output.sink)
+                logOutputStats();
+            unique_ptr<FrameSink> device;
+            if (output.spec.shmName.empty())
+                device = unique_ptr<FrameSink>(
+                    new V4l2Output(size.width, size.height, "/dev/video" + to_string(output.spec.device), output.spec.format, _state.outMmap));
+            else // Enough slots for the queued frames, the one being written and the last published one
+                device = unique_ptr<FrameSink>(new ShmOutput(size.width, size.height, output.spec.shmName, output.spec.format, _state.outQueueSize + 2));
+            output.sink = unique_ptr<AsyncOutput>(new AsyncOutput(move(device), _state.outQueueSize, _state.outPolicy));
+        }
+
+        if (!*output.sink)
+            continue;
+
+        if (outputFrame.total() == 0)
+        {
+            auto scaled = _outputPyramid.getScaled(size);
+            if (scaled.total() == 0)
+                continue;
+
+            // Convert straight into a device buffer if one is free
+            size_t frameSize = output::getFrameSize(output.spec.format, size.width, size.height);
+            uint8_t* buffer = output.sink->acquireBuffer();
+            if (buffer)
+                outputFrame = cv::Mat(1, frameSize, CV_8UC1, buffer);
+            else
+                outputFrame = _outputPool.get(cv::Size(frameSize, 1), CV_8UC1);
+            output::convertRows(scaled, outputFrame.data, output.spec.format, 0, scaled.rows);
+        }
+
+        // The frame is sent from the sink thread, so a stalled consumer does not block us
+        output.sink->push(outputFrame);
+    }
+
+    _outputPool.newFrame();
+    if (++_outputFrameIndex % _outputStatsPeriod == 0)
+        logOutputStats();
 }
 
 /*************/
@@ -145,6 +346,7 @@ void GifBox::run()
                     // Get current film frame
                     auto frame = _films[0].getCurrentFrame();
                     auto frameMask = _films[0].getCurrentMask();
+                    auto& frameMaskTiles = _films[0].getCurrentMaskTiles();
 
                     // If we just changed frame in the film, we save the previous merge result
                     bool recordEnded = false;
@@ -152,37 +354,42 @@ void GifBox::run()
                     if (frameSaved)
                         recordEnded = _layerMerger->saveFrame();
 
+                    // Flash the borders of the image if the previous frame was saved
+                    if (recordEnded && frameSaved)
+                        _flash->trigger();
+
                     cv::Mat cameraMaskBG, cameraMaskFG;
                     cv::threshold(depthMask, cameraMaskBG, _state.bgLimit, 255, cv::THRESH_BINARY_INV);
                     cv::threshold(depthMask, cameraMaskFG, _state.fgLimit, 255, cv::THRESH_BINARY_INV);
-                    auto finalImage = _layerMerger->mergeLayersWithMasks({frame[1], rgbFrame, frame[0], rgbFrame},
-                                                                       {cameraMaskBG, frameMask[0], cameraMaskFG});
-
-                    // Flash the borders of the image if the previous frame was saved
-                    if (recordEnded && frameSaved)
-                    {
-                        int margin = _state.flashMargin;
-                        cv::Mat imageRegion = cv::Mat(finalImage, cv::Rect(margin, margin, finalImage.cols - margin * 2, finalImage.rows - margin * 2));
-                        cv::Mat regionCopy = imageRegion.clone();
-                        finalImage *= 2.0;
-                        regionCopy.copyTo(imageRegion);
-                    }
+                    // Film background, camera, film foreground, camera
+                    array<LayerMerger::Layer, 4> layers {{{frame[1]},
+                                                          {rgbFrame, cameraMaskBG},
+                                                          {frame[0], frameMask[0], _films[0].isPremultiplied(), &frameMaskTiles[0]},
+                                                          {rgbFrame, cameraMaskFG}}};
+
+                    // The fixed layout compositor needs the camera and the film to have the same size and format
+                    auto filmSize = frame[1].size();
+                    bool isFixedLayout = rgbFrame.size() == filmSize && depthMask.size() == filmSize && frame[0].size() == filmSize
+                                         && rgbFrame.type() == CV_8UC3 && frame[0].type() == CV_8UC3 && frame[1].type() == CV_8UC3;
+
+                    // In streaming mode, the merger writes the output directly into a device buffer if one is free
+                    uint8_t* deviceBuffer = nullptr;
+                    if (_outputs[0].sink)
+                        deviceBuffer = _outputs[0].sink->acquireBuffer();
+                    if (deviceBuffer)
+                        _layerMerger->setOutputBuffer(deviceBuffer, _outputs[0].sink->getFrameSize());
+
+                    cv::Mat finalImage;
+                    if (isFixedLayout)
+                        finalImage = _layerMerger->mergeLayers<4, LayerMerger::PixelFormat::bgr>(layers);
+                    else
+                        finalImage = _layerMerger->mergeLayers(vector<LayerMerger::Layer>(layers.begin(), layers.end()));
 
                     if (_state.show)
                         cv::imshow("Result", finalImage);
 
                     // Write the result to v4l2
-                    //if (_state.sendToV4l2)
-                    //{
-                        if (!_v4l2Sink || finalImage.rows != _v4l2Sink->getHeight() || finalImage.cols != _v4l2Sink->getWidth())
-                            _v4l2Sink = unique_ptr<V4l2Output>(new V4l2Output(finalImage.cols, finalImage.rows, "/dev/video" + to_string(_state.camOut)));
-                        if (*_v4l2Sink)
-                        {
-                            //cv::Mat rgbImage;
-                            //cv::cvtColor(finalImage, rgbImage, cv::COLOR_BGR2RGB);
-                            _v4l2Sink->writeToDevice(finalImage.data, finalImage.total() * finalImage.elemSize());
-                        }
-                    //}
+                    sendToOutputs(finalImage, deviceBuffer);
                 }
             }
         }
@@ -262,12 +469,13 @@ void GifBox::run()
                     auto filename = command.args[1].asString();
                     int frameNbr = command.args[2].asInt();
                     float frameRate = command.args[3].asFloat();
-                    FilmPlayer film("./films/" + filename + "/", frameNbr, 2, frameRate);
+                    FilmPlayer film("./films/" + filename + "/", frameNbr, 2, frameRate, true);
                     if (film)
                     {
                         _films.clear();
                         _films.push_back(film);
                         _films[0].start();
+                        seedGifPalette();
                         _state.currentFilm = filename;
                         _state.frameNbr = frameNbr;
                         _state.fps = frameRate;
@@ -361,6 +569,24 @@ void GifBox::processKeyEvent(short key)
     }
 }
 
+/*************/
+void GifBox::seedGifPalette()
+{
+    if (_films.size() == 0)
+        return;
+
+    auto& film = _films[0];
+    vector<cv::Mat> backgrounds;
+    for (int i = 0; i < film.getFrameNbr(); ++i)
+    {
+        auto& planes = film.getFrame(i);
+        if (planes.size() != 0)
+            backgrounds.push_back(planes[planes.size() - 1]);
+    }
+
+    _layerMerger->setGifPaletteSeed(backgrounds);
+}
+
 /*************/
 int main(int argc, char** argv)
 {
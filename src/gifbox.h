@@ -17,6 +17,7 @@
  * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <array>
 #include <chrono>
 #include <iostream>
 #include <memory>
@@ -26,10 +27,15 @@
 
 #include <opencv2/opencv.hpp>
 
+#include "./asyncOutput.h"
 #include "./filmPlayer.h"
+#include "./framePool.h"
 #include "./httpServer.h"
 #include "./layerMerger.h"
+#include "./outputPyramid.h"
+#include "./overlay.h"
 //#include "./rgbdCamera.h"
+#include "./shmOutput.h"
 #include "./v4l2output.h"
 #include "./k2Camera.h"
 #include "./values.h"
@@ -44,6 +50,16 @@ class GifBox
         void run();
 
     private:
+        // A v4l2 output device, or a shared memory ring if shmName is set
+        // A size of 0 means the size of the composited frame
+        struct OutputSpec
+        {
+            int device {0};
+            std::string shmName {""};
+            cv::Size size {0, 0};
+            output::Format format {output::Format::rgb24};
+        };
+
         struct State
         {
             bool run {true};
@@ -56,6 +72,11 @@ class GifBox
             int cam1 {1};
             int cam2 {2};
             int camOut {0};
+            output::Format outFormat {output::Format::rgb24};
+            bool outMmap {false};
+            int outQueueSize {2};
+            AsyncOutput::Policy outPolicy {AsyncOutput::Policy::dropOldest};
+            std::vector<OutputSpec> extraOutputs {};
         
             std::string currentFilm {"ALL_THE_RAGE"};
             int frameNbr {0};
@@ -65,6 +86,12 @@ class GifBox
             int bgLimit {45};
         
             int flashMargin {16};
+
+            int threads {1};
+            gif::Dithering gifDithering {gif::Dithering::none};
+            int gifThreads {0};
+            bool gifIncremental {false};
+            int recordMemory {64}; // In MB
         } _state;
 
         std::unique_ptr<HttpServer> _httpServer;
@@ -72,9 +99,27 @@ class GifBox
         std::vector<FilmPlayer> _films;
         //std::unique_ptr<StereoCamera> _stereoCamera;
         std::unique_ptr<K2Camera> _camera;
-        std::unique_ptr<V4l2Output> _v4l2Sink;
+        // The first output gets the frame converted while compositing, the others
+        // are scaled and converted afterwards, each size being computed once
+        struct Output
+        {
+            OutputSpec spec {};
+            std::unique_ptr<AsyncOutput> sink {nullptr};
+        };
+        std::vector<Output> _outputs;
+        OutputPyramid _outputPyramid {};
+        FramePool _outputPool {};
+        uint64_t _outputFrameIndex {0};
+        static const uint64_t _outputStatsPeriod = 300; // In frames
         std::unique_ptr<LayerMerger> _layerMerger;
+        std::shared_ptr<FlashOverlay> _flash;
 
+        void logOutputStats();
+        void sendToOutputs(const cv::Mat& finalImage, uint8_t* deviceBuffer);
         void parseArguments(int argc, char** argv);
+        // Parse the size and format of an output, given as [WIDTHxHEIGHT[:FORMAT]]
+        void parseOutputSpec(const std::string& arg, OutputSpec& spec);
         void processKeyEvent(short key);
+        // Seed the palette of the recorded GIFs with the background of the current film
+        void seedGifPalette();
 };
@@ -1,5 +1,8 @@
 #include "layerMerger.h"
 
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <iostream>
 #include <limits>
 
@@ -21,11 +24,19 @@ LayerMerger::LayerMerger()
     _logoONF = cv::imread("logoONF.png", cv::IMREAD_COLOR);
     if (_logoONF.total() == 0)
         cout << "LayerMerger: could not load logo file logoONF.png" << endl;
+    else
+        addOverlay(make_shared<LogoOverlay>(_logoONF, 0.35), OverlayStage::recorded);
+
+    // The record progress bar is only shown live
+    _progressBar = make_shared<ProgressBarOverlay>(16, cv::Scalar(255, 64, 64));
+    addOverlay(_progressBar, OverlayStage::live);
 }
 
 /*************/
 LayerMerger::~LayerMerger()
 {
+    if (_gifThread.joinable())
+        _gifThread.join();
 }
 
 /*************/
@@ -37,77 +48,226 @@ cv::Mat LayerMerger::mergeLayersWithMasks(const vector<cv::Mat>& layers, const v
         return {};
     }
 
-    auto frameSize = layers[0].size();
-    cv::Mat mergeResult = layers[0].clone();
-
-    for (unsigned int i = 1; i < layers.size(); ++i)
+    _inputLayers.resize(layers.size());
+    for (unsigned int i = 0; i < layers.size(); ++i)
     {
-        cv::Mat tmpLayer = layers[i].clone();
-        cv::Mat tmpAlpha = masks[i - 1];
+        _inputLayers[i].image = layers[i];
+        _inputLayers[i].mask = i > 0 ? masks[i - 1] : cv::Mat();
+        _inputLayers[i].premultiplied = false;
+    }
 
-        if (layers[i].size() != frameSize)
-            cv::resize(layers[i], tmpLayer, frameSize, cv::INTER_LINEAR);
-        if (masks[i - 1].size() != frameSize)
-            cv::resize(masks[i - 1], tmpAlpha, frameSize, cv::INTER_LINEAR);
+    auto mergeResult = mergeLayers(_inputLayers);
 
-        cv::Mat alpha;
-        cv::cvtColor(tmpAlpha, alpha, cv::COLOR_GRAY2BGR);
+    for (auto& layer : _inputLayers)
+        layer = Layer();
 
-        tmpLayer = tmpLayer.mul(alpha, 1.0 / 255.0);
+    return mergeResult;
+}
 
-        for (int y = 0; y < mergeResult.rows; ++y)
-            for (int x = 0; x < mergeResult.cols; ++x)
-            {
-                auto alphaValue = alpha.at<cv::Vec3b>(y, x)[0];
-                if (alphaValue == 0)
-                {
-                    continue;
-                }
-                else if (alphaValue == 255)
-                {
-                    mergeResult.at<cv::Vec3b>(y, x)[0] = tmpLayer.at<cv::Vec3b>(y, x)[0];
-                    mergeResult.at<cv::Vec3b>(y, x)[1] = tmpLayer.at<cv::Vec3b>(y, x)[1];
-                    mergeResult.at<cv::Vec3b>(y, x)[2] = tmpLayer.at<cv::Vec3b>(y, x)[2];
-                }
-                else
-                {
-                    mergeResult.at<cv::Vec3b>(y, x)[0] = ((255 - alphaValue) * mergeResult.at<cv::Vec3b>(y, x)[0] + alphaValue * tmpLayer.at<cv::Vec3b>(y, x)[0]) / 255;
-                    mergeResult.at<cv::Vec3b>(y, x)[1] = ((255 - alphaValue) * mergeResult.at<cv::Vec3b>(y, x)[1] + alphaValue * tmpLayer.at<cv::Vec3b>(y, x)[1]) / 255;
-                    mergeResult.at<cv::Vec3b>(y, x)[2] = ((255 - alphaValue) * mergeResult.at<cv::Vec3b>(y, x)[2] + alphaValue * tmpLayer.at<cv::Vec3b>(y, x)[2]) / 255;
-                }
-            }
+/*************/
+cv::Mat LayerMerger::mergeLayers(const vector<Layer>& layers)
+{
+    if (layers.size() == 0)
+        return {};
+
+    for (unsigned int i = 1; i < layers.size(); ++i)
+    {
+        if (layers[i].image.type() != layers[0].image.type() || layers[i].mask.type() != CV_8UC1)
+        {
+            cout << "LayerMerger: layer " << i << " or its mask has an unsupported type" << endl;
+            return {};
+        }
     }
 
-    // Add the logo
-    if (_logoONF.total() > 0)
+    auto frameSize = layers[0].image.size();
+
+    // Everything must be at the size of the first layer before compositing
+    // Premultiplied layers are resized as is, which is close enough to premultiplying the resized layer
+    _resizedLayers.resize(layers.size());
+    _resizedLayers[0].image = layers[0].image;
+    for (unsigned int i = 1; i < layers.size(); ++i)
     {
-        cv::Mat tmpMat = _logoONF.clone();
-        cv::Mat logo;
-        if (tmpMat.size() != frameSize)
-            cv::resize(tmpMat, logo, frameSize, cv::INTER_LINEAR);
+        auto& layer = layers[i];
+        auto& resizedLayer = _resizedLayers[i];
+        resizedLayer.premultiplied = layer.premultiplied;
+        resizedLayer.tiles = nullptr;
+
+        if (layer.image.size() != frameSize)
+            resizedLayer.image = getResized(layer.image, frameSize);
         else
-            logo = tmpMat;
-        logo = logo * 0.35;
-        mergeResult += logo;
+            resizedLayer.image = layer.image;
+
+        if (layer.mask.size() != frameSize)
+            resizedLayer.mask = getResized(layer.mask, frameSize);
+        else
+        {
+            resizedLayer.mask = layer.mask;
+            if (layer.tiles && *layer.tiles && layer.tiles->getMaskSize() == frameSize)
+                resizedLayer.tiles = layer.tiles;
+        }
     }
 
-    _mergeResult = mergeResult.clone();
+    cv::Mat mergeResult = _framePool.get(frameSize, layers[0].image.type());
+
+    // The frame is split in horizontal bands, processed in parallel if a worker pool is set
+    prepareFrame(mergeResult);
+    auto compositeBand = [this, &mergeResult](unsigned int index) {
+        auto& band = _bands[index];
+        compositeRows(_resizedLayers, mergeResult, band.firstRow, band.lastRow, band.alphaRow);
+        finishRows(mergeResult, band.firstRow, band.lastRow);
+    };
 
-    //if (_saveMergerResult)
-    //{
-    //    // Add a record progress bar
-    //    // The frame is inverted, we draw it from the other side
-    //    cv::Mat layer = cv::Mat::zeros(frameSize, CV_8UC3);
-    //    auto lowerLeft = cv::Point(frameSize.width, frameSize.height - 16);
-    //    auto upperRight = cv::Point(frameSize.width - (frameSize.width * _saveImageIndex) / _maxRecordTime, frameSize.height);
-    //    cv::rectangle(layer, lowerLeft, upperRight, cv::Scalar(255, 64, 64), CV_FILLED);
+    if (_workerPool)
+        _workerPool->run(_bands.size(), compositeBand);
+    else
+        compositeBand(0);
+
+    // Drop the references to the inputs and to the pooled buffers
+    for (auto& layer : _resizedLayers)
+        layer = Layer();
+    _resizeCache.clear();
 
-    //    mergeResult += layer;
-    //}
+    finishFrame();
 
     return mergeResult;
 }
 
+/*************/
+cv::Mat LayerMerger::getResized(const cv::Mat& source, cv::Size size)
+{
+    for (auto& entry : _resizeCache)
+    {
+        if (entry.data == source.data && entry.step == source.step[0] && entry.sourceSize == source.size()
+            && entry.type == source.type() && entry.resized.size() == size)
+        {
+            _resizeCacheHits++;
+            return entry.resized;
+        }
+    }
+
+    _resizeCacheMisses++;
+    cv::Mat resized = _framePool.get(size, source.type());
+    cv::resize(source, resized, size, 0, 0, cv::INTER_LINEAR);
+
+    ResizeCacheEntry entry;
+    entry.data = source.data;
+    entry.step = source.step[0];
+    entry.sourceSize = source.size();
+    entry.type = source.type();
+    entry.resized = resized;
+    _resizeCache.push_back(entry);
+
+    return resized;
+}
+
+/*************/
+void LayerMerger::prepareFrame(const cv::Mat& mergeResult)
+{
+    updateBands(mergeResult.rows);
+
+    if (_saveMergerResult)
+        _progressBar->setProgress(static_cast<float>(_saveImageIndex) / static_cast<float>(_maxRecordTime));
+    else
+        _progressBar->setProgress(0.f);
+
+    for (auto& overlay : _recordedOverlays)
+        overlay->prepare(mergeResult);
+    for (auto& overlay : _liveOverlays)
+        overlay->prepare(mergeResult);
+
+    // Kept for saveFrame, as the caller may modify the returned frame. It comes from the pool
+    // as the recorder may still be writing the previous one
+    _mergeResult = _framePool.get(mergeResult.size(), mergeResult.type());
+
+    size_t outputSize = output::getFrameSize(_outputFormat, mergeResult.cols, mergeResult.rows);
+    if (!_outputEnabled)
+        _outputFrame = cv::Mat();
+    else if (_outputBuffer && _outputBufferSize == outputSize)
+        _outputFrame = cv::Mat(1, outputSize, CV_8UC1, _outputBuffer);
+    else
+        _outputFrame = _framePool.get(cv::Size(outputSize, 1), CV_8UC1);
+
+    _outputBuffer = nullptr;
+    _outputBufferSize = 0;
+}
+
+/*************/
+void LayerMerger::finishRows(cv::Mat& mergeResult, int firstRow, int lastRow)
+{
+    for (auto& overlay : _recordedOverlays)
+        overlay->apply(mergeResult, firstRow, lastRow);
+
+    size_t rowLength = mergeResult.cols * mergeResult.elemSize();
+    for (int y = firstRow; y < lastRow; ++y)
+        memcpy(_mergeResult.ptr<uint8_t>(y), mergeResult.ptr<uint8_t>(y), rowLength);
+
+    for (auto& overlay : _liveOverlays)
+        overlay->apply(mergeResult, firstRow, lastRow);
+
+    // The band is still in cache, converting it now saves a pass over the frame
+    if (_outputFrame.data)
+        output::convertRows(mergeResult, _outputFrame.data, _outputFormat, firstRow, lastRow);
+}
+
+/*************/
+void LayerMerger::finishFrame()
+{
+    // Frame buffers should only be allocated during the first frames
+    _frameAllocations = _framePool.newFrame();
+    if (_frameAllocations > 0 && _frameIndex >= _poolWarmupFrames)
+        cout << "LayerMerger: " << _frameAllocations << " frame buffer(s) allocated for frame " << _frameIndex << endl;
+    _frameIndex++;
+}
+
+/*************/
+void LayerMerger::addOverlay(shared_ptr<Overlay> overlay, OverlayStage stage)
+{
+    if (!overlay)
+        return;
+
+    if (stage == OverlayStage::recorded)
+        _recordedOverlays.push_back(overlay);
+    else
+        _liveOverlays.push_back(overlay);
+}
+
+/*************/
+void LayerMerger::updateBands(int rows)
+{
+    unsigned int bandNbr = 1;
+    if (_workerPool)
+        bandNbr = max(1, min<int>(_workerPool->getThreadNbr() * 2, rows / _minRowsPerBand));
+
+    if (_bands.size() == bandNbr && _bands.back().lastRow == rows)
+        return;
+
+    _bands.resize(bandNbr);
+    for (unsigned int i = 0; i < bandNbr; ++i)
+    {
+        _bands[i].firstRow = (rows * i / bandNbr) & ~1;
+        _bands[i].lastRow = (i + 1 == bandNbr) ? rows : (rows * (i + 1) / bandNbr) & ~1;
+    }
+}
+
+/*************/
+void LayerMerger::compositeRows(const vector<Layer>& layers, cv::Mat& result, int firstRow, int lastRow, vector<uint8_t>& alphaRow)
+{
+    int channels = result.channels();
+    size_t rowLength = result.cols * channels;
+    alphaRow.resize(rowLength);
+
+    // Each output row is built in a single pass over all layers: inputs are
+    // read once, and the row stays in cache until it is complete
+    for (int y = firstRow; y < lastRow; ++y)
+    {
+        uint8_t* resultRow = result.ptr<uint8_t>(y);
+        memcpy(resultRow, layers[0].image.ptr<uint8_t>(y), rowLength);
+
+        for (unsigned int i = 1; i < layers.size(); ++i)
+            blendLayerRow<0>(layers[i], resultRow, y, result.cols, channels, alphaRow.data());
+    }
+}
+
 /*************/
 bool LayerMerger::saveFrame()
 {
@@ -117,9 +277,8 @@ bool LayerMerger::saveFrame()
     if (_saveMergerResult)
     {
         auto filename = getFilename();
-        cv::Mat resizedImage;
-        cv::resize(_mergeResult, resizedImage, cv::Size(), 0.5, 0.5, cv::INTER_LINEAR);
-        cv::imwrite(filename, resizedImage, {cv::IMWRITE_PNG_COMPRESSION, 9});
+        _recorder.push(_mergeResult, filename);
+        _recordedFilenames.push_back(filename);
         _saveImageIndex++;
 
         if (_saveImageIndex >= _maxRecordTime)
@@ -137,16 +296,133 @@ bool LayerMerger::saveFrame()
     return false;
 }
 
+/*************/
+void LayerMerger::setOutput(bool enabled, output::Format format)
+{
+    _outputEnabled = enabled;
+    _outputFormat = format;
+
+    if (enabled)
+        cout << "LayerMerger: writing the output as " << output::getFormatName(format) << endl;
+}
+
+/*************/
+void LayerMerger::setOutputBuffer(uint8_t* buffer, size_t size)
+{
+    _outputBuffer = buffer;
+    _outputBufferSize = size;
+}
+
+/*************/
+void LayerMerger::setGifDithering(gif::Dithering dithering)
+{
+    _gifDithering = dithering;
+
+    cout << "LayerMerger: GIF dithering set to " << gif::getDitheringName(dithering) << endl;
+}
+
+/*************/
+void LayerMerger::setGifIncremental(bool incremental)
+{
+    _gifIncremental = incremental;
+
+    if (incremental)
+        cout << "LayerMerger: encoding GIFs while recording" << endl;
+    else
+        cout << "LayerMerger: encoding GIFs once the record ends" << endl;
+}
+
+/*************/
+void LayerMerger::setGifPaletteSeed(const vector<cv::Mat>& frames)
+{
+    auto seed = make_shared<gif::Histogram>();
+    if (frames.size() != 0)
+    {
+        // The seed weighs about as much as a recorded frame, at half the size of the film,
+        // so that the colors of the guests in the first frame are not drowned out
+        unsigned int sampleNbr = min<unsigned int>(frames.size(), _gifSeedFrameNbr);
+        int step = max(1, static_cast<int>(lround(2.0 * sqrt(sampleNbr))));
+        for (unsigned int i = 0; i < sampleNbr; ++i)
+            seed->add(frames[i * frames.size() / sampleNbr], step);
+    }
+
+    _gifSeed = seed;
+}
+
+/*************/
+void LayerMerger::setGifThreadNbr(unsigned int threadNbr)
+{
+    if (threadNbr == 0)
+        threadNbr = max(1u, thread::hardware_concurrency());
+    _gifThreadNbr = threadNbr;
+
+    cout << "LayerMerger: encoding GIFs with " << threadNbr << " thread(s)" << endl;
+}
+
+/*************/
+void LayerMerger::setRecordMemoryLimit(size_t limit)
+{
+    _recorder.setMemoryLimit(limit);
+
+    if (limit == 0)
+        cout << "LayerMerger: recorded frames go through the disk" << endl;
+    else
+        cout << "LayerMerger: recorded frames are kept in memory, up to " << limit / (1024 * 1024) << " MB" << endl;
+}
+
+/*************/
+void LayerMerger::setThreadNbr(unsigned int threadNbr)
+{
+    if (threadNbr == 0)
+        threadNbr = max(1u, thread::hardware_concurrency());
+
+    if (threadNbr == 1)
+        _workerPool.reset();
+    else if (!_workerPool || _workerPool->getThreadNbr() != threadNbr)
+        _workerPool = unique_ptr<WorkerPool>(new WorkerPool(threadNbr));
+
+    cout << "LayerMerger: compositing with " << threadNbr << " thread(s)" << endl;
+}
+
+/*************/
+uint32_t LayerMerger::recordingLeft()
+{
+    uint64_t written = _recorder.getWrittenNbr() - _recordStartWritten;
+    return written >= _maxRecordTime ? 0 : _maxRecordTime - written;
+}
+
 /*************/
 void LayerMerger::setSaveMerge(bool save, string basename, int maxRecordTime)
 {
     if (save)
         _saveIndex++;
 
+    // Frames of an interrupted record are not encoded, so its GIF is dropped
+    // or the frames kept in memory are freed
+    if (_recordingGif)
+        _recorder.finishGif(true);
+
+    // Frames of the previous record may still be queued. They are recorded before counting
+    // the written frames, so that they are not counted in the new record
+    _recorder.flush();
+    _recordStartWritten = _recorder.getWrittenNbr();
+
+    if (!_recordingGif)
+        for (auto& filename : _recordedFilenames)
+            _recorder.takeFrame(filename);
+    _recordingGif = false;
+    _recordedFilenames.clear();
+
     _saveMergerResult = save;
     _saveBasename = basename;
     _saveImageIndex = 0;
 
+    if (save && _gifIncremental)
+    {
+        _recorder.startGif("/tmp/" + getGifName() + ".gif", _gifSeed, _gifFrameDelay, _gifDithering);
+        _recordingGif = true;
+    }
+
     playSound("Super8.wav");
 
     if (maxRecordTime == 0)
@@ -166,17 +442,78 @@ string LayerMerger::getFilename()
     return filename;
 }
 
+/*************/
+string LayerMerger::getGifName()
+{
+    return "gifbox_result_" + to_string(_saveIndex);
+}
+
 /*************/
 void LayerMerger::convertSequenceToGif()
 {
-    auto basename = "gifbox_result_" + to_string(_saveIndex);
+    auto basename = getGifName();
     _lastRecordName = basename;
-    string cmd = "convertToGif";
-    char* argv[] = {(char*)"convertToGif", (char*)basename.c_str(), nullptr};
 
-    int pid;
-    posix_spawn(&pid, cmd.c_str(), nullptr, nullptr, argv, nullptr);
-    //waitpid(pid, nullptr, 0);
+    // The recorder finishes the file once it has encoded the last frames
+    if (_recordingGif)
+    {
+        _recorder.finishGif();
+        _recordingGif = false;
+        _recordedFilenames.clear();
+        return;
+    }
+
+    // Only one record is encoded at a time
+    if (_gifThread.joinable())
+        _gifThread.join();
+
+    auto filenames = move(_recordedFilenames);
+    _recordedFilenames.clear();
+    auto dithering = _gifDithering;
+    auto threadNbr = _gifThreadNbr;
+    _gifPending = true;
+
+    auto recordEnd = chrono::high_resolution_clock::now();
+    _gifThread = thread([=]() {
+        // The last frames may still be queued in the recorder
+        _recorder.flush();
+
+        // Frames are read back from disk only if they did not fit in memory
+        vector<cv::Mat> frames;
+        vector<string> diskFilenames;
+        for (auto& filename : filenames)
+        {
+            auto frame = _recorder.takeFrame(filename);
+            if (frame.total() == 0)
+            {
+                frame = cv::imread(filename, cv::IMREAD_COLOR);
+                diskFilenames.push_back(filename);
+            }
+            if (frame.total() != 0)
+                frames.push_back(frame);
+        }
+
+        auto gifFilename = "/tmp/" + basename + ".gif";
+        auto encodeStart = chrono::high_resolution_clock::now();
+        if (!GifEncoder::encode(frames, gifFilename, _gifFrameDelay, dithering, threadNbr))
+        {
+            cout << "LayerMerger: could not encode " << gifFilename << endl;
+        }
+        else
+        {
+            auto encodeEnd = chrono::high_resolution_clock::now();
+            cout << "LayerMerger: encoded " << frames.size() << " frames to " << gifFilename << " in "
+                 << chrono::duration_cast<chrono::milliseconds>(encodeEnd - encodeStart).count() << " ms with " << threadNbr << " thread(s), "
+                 << chrono::duration_cast<chrono::milliseconds>(encodeEnd - recordEnd).count() << " ms after the end of the record" << endl;
+        }
+
+        for (auto& filename : diskFilenames)
+            remove(filename.c_str());
+        if (diskFilenames.size() != 0)
+            cout << "LayerMerger: " << diskFilenames.size() << " of " << filenames.size() << " frames did not fit in memory and went through the disk" << endl;
+
+        _gifPending = false;
+    });
 }
 
 /*************/
@@ -20,12 +20,27 @@
 #ifndef LAYERMERGER_H
 #define LAYERMERGER_H
 
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include "./blendKernels.h"
+#include "./framePool.h"
+#include "./frameRecorder.h"
+#include "./gifEncoder.h"
+#include "./maskTiles.h"
+#include "./outputFormat.h"
+#include "./overlay.h"
+#include "./workerPool.h"
+
 /*************/
 class LayerMerger
 {
@@ -41,23 +56,120 @@ class LayerMerger
             return name;
         }
 
+        // A layer, blended over the ones below it through its mask
+        struct Layer
+        {
+            Layer(cv::Mat i = cv::Mat(), cv::Mat m = cv::Mat(), bool p = false, const MaskTiles* t = nullptr)
+                : image(i), mask(m), premultiplied(p), tiles(t) {}
+
+            cv::Mat image;
+            cv::Mat mask; // Single channel, unused for the bottom layer
+            bool premultiplied; // True if image has already been multiplied by mask, as FilmPlayer can do
+            const MaskTiles* tiles; // Optional, lets the compositor skip transparent tiles and copy opaque ones
+        };
+
+        // Pixel formats supported by the fixed layout compositor
+        enum class PixelFormat
+        {
+            bgr, // CV_8UC3
+            bgrx // CV_8UC4, the fourth byte being padding
+        };
+
         // Layers from back to front, with one mask between each of them
         // Everything is resized to the size of the first layer
         cv::Mat mergeLayersWithMasks(const std::vector<cv::Mat>& layers, const std::vector<cv::Mat>& masks);
 
+        // Same as mergeLayersWithMasks, with each mask held by the layer it applies to
+        // Straight layers are multiplied by their mask while blending, premultiplied ones are blended directly
+        cv::Mat mergeLayers(const std::vector<Layer>& layers);
+
+        // Same as mergeLayers, specialized at compile time for a fixed layout
+        // Nothing is resized nor checked (except in debug builds): all layers must
+        // have the given format, and all layers and masks the same size
+        template<size_t LayerNbr, PixelFormat Format>
+        cv::Mat mergeLayers(const std::array<Layer, LayerNbr>& layers);
+
         // Save the current merged frame, return true if sequence is complete
         bool saveFrame();
 
         // Activate saving
         void setSaveMerge(bool save, std::string basename = "", int maxRecordTime =  0);
 
-        bool isRecording() {return _saveMergerResult;}
-        uint32_t recordingLeft() {return _maxRecordTime - _saveImageIndex;}
+        // Overlays applied at the recorded stage end up in the saved frames, live ones only in the returned frames
+        enum class OverlayStage
+        {
+            recorded,
+            live
+        };
+
+        // Add an overlay, applied in place to every merged frame after the ones already added to the same stage
+        void addOverlay(std::shared_ptr<Overlay> overlay, OverlayStage stage);
+
+        // Also write each merged frame in the given format, as its bands are composited
+        // This costs no additional pass over the frame, see getOutputFrame
+        void setOutput(bool enabled, output::Format format = output::Format::rgb24);
+
+        // Write the next merged frame in the given buffer instead of an internal one, for example
+        // a mmap'd device buffer. It is only used if its size matches the frame in the output format
+        void setOutputBuffer(uint8_t* buffer, size_t size);
+
+        // Last merged frame in the output format, as a single row of bytes
+        // Empty if output is disabled
+        cv::Mat getOutputFrame() const {return _outputFrame;}
+
+        // Keep the recorded frames in memory up to limit bytes, instead of writing them as PNG files
+        // Frames beyond the limit go through the disk. 0 sends all frames through the disk
+        // Only used when encoding once the record ends, as frames are not kept while recording
+        void setRecordMemoryLimit(size_t limit);
+
+        // Dithering of the recorded GIFs
+        void setGifDithering(gif::Dithering dithering);
+
+        // Encode the recorded GIFs while recording, or once the record ends, the default
+        // Encoding while recording uses a palette built from the seed and the first frame,
+        // while encoding at the end uses all frames, but has to wait for the encode
+        void setGifIncremental(bool incremental);
+
+        // Set the frames the GIF palette is seeded with, usually the ones of the film
+        void setGifPaletteSeed(const std::vector<cv::Mat>& frames);
+
+        // Set the number of threads encoding the recorded GIFs, 0 to use all cores
+        // Frames are encoded in parallel, the file being the same whatever the number of threads
+        // Only used when encoding once the record ends, GIFs encoded while recording using one thread
+        void setGifThreadNbr(unsigned int threadNbr);
+
+        // Set the number of threads used for compositing, 0 to use all cores
+        // The output is the same whatever the number of threads
+        void setThreadNbr(unsigned int threadNbr);
+
+        // Number of frame buffers allocated while merging the last frame
+        // Once warmed up, this should stay at 0 as long as the frame size does not change
+        unsigned int getFrameAllocations() const {return _frameAllocations;}
+
+        // Number of resizes avoided and done since the start, inputs used
+        // more than once in a frame being resized only once
+        uint64_t getResizeCacheHits() const {return _resizeCacheHits;}
+        uint64_t getResizeCacheMisses() const {return _resizeCacheMisses;}
+
+        // A record goes on until its frames are written and its GIF encoded
+        bool isRecording() {return _saveMergerResult || _gifPending || _recorder.isGifPending();}
+        // Frames of the current record not yet written
+        uint32_t recordingLeft();
 
     private:
         cv::Mat _mergeResult;
         cv::Mat _logoONF;
 
+        std::vector<std::shared_ptr<Overlay>> _recordedOverlays {};
+        std::vector<std::shared_ptr<Overlay>> _liveOverlays {};
+        std::shared_ptr<ProgressBarOverlay> _progressBar {nullptr};
+
+        bool _outputEnabled {false};
+        output::Format _outputFormat {output::Format::rgb24};
+        cv::Mat _outputFrame {};
+        uint8_t* _outputBuffer {nullptr}; // Set by setOutputBuffer, for the next frame only
+        size_t _outputBufferSize {0};
+
         std::string _saveBasename {""};
         unsigned int _saveIndex {0};
 
@@ -69,10 +181,86 @@ class LayerMerger
 
         int _currentVLCPid {-1};
 
+        std::vector<std::string> _recordedFilenames {}; // Frames of the current record
+        FrameRecorder _recorder {0.5};
+        uint64_t _recordStartWritten {0}; // Frames written by the recorder when the record started
+        std::atomic<bool> _gifPending {false};
+        std::thread _gifThread {};
+        static const int _gifFrameDelay = 10; // In hundredths of a second
+        gif::Dithering _gifDithering {gif::Dithering::none};
+        unsigned int _gifThreadNbr {1};
+        bool _gifIncremental {false};
+        bool _recordingGif {false}; // The current record is encoded by the recorder
+        std::shared_ptr<const gif::Histogram> _gifSeed {nullptr};
+        static const unsigned int _gifSeedFrameNbr = 8; // At most, evenly spaced
+
+        FramePool _framePool {};
+        static const uint64_t _poolWarmupFrames = 2;
+        uint64_t _frameIndex {0};
+        unsigned int _frameAllocations {0};
+        std::vector<Layer> _inputLayers {};
+        std::vector<Layer> _resizedLayers {};
+
+        // Inputs resized during the current frame, identified by their buffer
+        struct ResizeCacheEntry
+        {
+            const uint8_t* data {nullptr};
+            size_t step {0};
+            cv::Size sourceSize {0, 0};
+            int type {0};
+            cv::Mat resized {};
+        };
+        std::vector<ResizeCacheEntry> _resizeCache {};
+        uint64_t _resizeCacheHits {0};
+        uint64_t _resizeCacheMisses {0};
+
+        struct Band
+        {
+            int firstRow {0};
+            int lastRow {0};
+            std::vector<uint8_t> alphaRow {}; // Mask row expanded to the layer channels
+        };
+
+        static const int _minRowsPerBand = 16;
+        std::unique_ptr<WorkerPool> _workerPool {nullptr};
+        std::vector<Band> _bands {};
+
+        // Resize an input to the given size, or get it from the resize cache
+        cv::Mat getResized(const cv::Mat& source, cv::Size size);
+
+        // Set up the bands, the overlays and the output for the frame about to be composited
+        void prepareFrame(const cv::Mat& mergeResult);
+
+        // Called on each band once composited: apply the overlays, keep the
+        // result for saveFrame and convert it to the output format
+        void finishRows(cv::Mat& mergeResult, int firstRow, int lastRow);
+
+        // Bookkeeping once all bands are done
+        void finishFrame();
+
+        // Split the frame in horizontal bands, two per compositing thread
+        // Bands start on even rows, as the i420 output converts rows by pairs
+        void updateBands(int rows);
+
+        // Composite the given rows of all layers into result, in a single pass
+        // Layers and masks must already be at the size of result
+        void compositeRows(const std::vector<Layer>& layers, cv::Mat& result, int firstRow, int lastRow, std::vector<uint8_t>& alphaRow);
+
+        // Blend a layer row into a result row, using the mask tiles if any
+        // Channels is the number of channels if known at compile time, 0 otherwise
+        template<int Channels>
+        void blendLayerRow(const Layer& layer, uint8_t* resultRow, int row, int columns, int channels, uint8_t* alphaRow);
+
+        // Blend the columns [firstColumn, lastColumn[ of a layer row into a result row
+        template<int Channels>
+        void blendRun(const Layer& layer, uint8_t* resultRow, int row, int firstColumn, int lastColumn, int channels, uint8_t* alphaRow);
+
         std::string getFilename();
+        // Name of the GIF of the current record, without extension
+        std::string getGifName();
 
-        // Converts the sequence to an animated gif asynchronously,
-        // by calling a script
+        // Converts the sequence to an animated gif asynchronously, then removes the frames
+        // If it has been encoded while recording, only the end of the file is written
         void convertSequenceToGif();
 
         // Plays a sound by invoking vlc
@@ -80,4 +268,106 @@ class LayerMerger
         void killSound();
 };
 
+/*************/
+template<size_t LayerNbr, LayerMerger::PixelFormat Format>
+cv::Mat LayerMerger::mergeLayers(const std::array<Layer, LayerNbr>& layers)
+{
+    static_assert(LayerNbr > 0, "LayerMerger: at least one layer is needed");
+    constexpr int channels = (Format == PixelFormat::bgr) ? 3 : 4;
+
+    auto frameSize = layers[0].image.size();
+#ifndef NDEBUG
+    for (size_t i = 0; i < LayerNbr; ++i)
+    {
+        assert(layers[i].image.type() == CV_MAKETYPE(CV_8U, channels) && layers[i].image.size() == frameSize);
+        assert(i == 0 || (layers[i].mask.type() == CV_8UC1 && layers[i].mask.size() == frameSize));
+        assert(!layers[i].tiles || layers[i].tiles->getMaskSize() == frameSize);
+    }
+#endif
+
+    cv::Mat mergeResult = _framePool.get(frameSize, CV_MAKETYPE(CV_8U, channels));
+    prepareFrame(mergeResult);
+
+    // Keeping the capture small lets std::function store it without allocating
+    struct Context
+    {
+        const std::array<Layer, LayerNbr>& layers;
+        cv::Mat& result;
+    } context {layers, mergeResult};
+
+    auto compositeBand = [this, &context](unsigned int index) {
+        auto& band = _bands[index];
+        const int columns = context.result.cols;
+        const size_t rowLength = columns * channels;
+        band.alphaRow.resize(rowLength);
+
+        for (int y = band.firstRow; y < band.lastRow; ++y)
+        {
+            uint8_t* resultRow = context.result.template ptr<uint8_t>(y);
+            memcpy(resultRow, context.layers[0].image.template ptr<uint8_t>(y), rowLength);
+
+            // The layer count is known, so this loop can be fully unrolled
+            for (size_t i = 1; i < LayerNbr; ++i)
+                blendLayerRow<channels>(context.layers[i], resultRow, y, columns, channels, band.alphaRow.data());
+        }
+
+        finishRows(context.result, band.firstRow, band.lastRow);
+    };
+
+    if (_workerPool)
+        _workerPool->run(_bands.size(), compositeBand);
+    else
+        compositeBand(0);
+
+    finishFrame();
+
+    return mergeResult;
+}
+
+/*************/
+template<int Channels>
+void LayerMerger::blendLayerRow(const Layer& layer, uint8_t* resultRow, int row, int columns, int channels, uint8_t* alphaRow)
+{
+    if (Channels != 0)
+        channels = Channels;
+
+    if (!layer.tiles)
+    {
+        blendRun<Channels>(layer, resultRow, row, 0, columns, channels, alphaRow);
+        return;
+    }
+
+    // Blending with an opaque mask gives back the layer, whether it is premultiplied or not
+    for (auto& run : layer.tiles->getRuns(row))
+    {
+        if (run.type == MaskTiles::opaque)
+            memcpy(resultRow + run.firstColumn * channels, layer.image.ptr<uint8_t>(row) + run.firstColumn * channels,
+                   (run.lastColumn - run.firstColumn) * channels);
+        else if (run.type == MaskTiles::mixed)
+            blendRun<Channels>(layer, resultRow, row, run.firstColumn, run.lastColumn, channels, alphaRow);
+    }
+}
+
+/*************/
+template<int Channels>
+void LayerMerger::blendRun(const Layer& layer, uint8_t* resultRow, int row, int firstColumn, int lastColumn, int channels, uint8_t* alphaRow)
+{
+    if (Channels != 0)
+        channels = Channels;
+
+    size_t offset = firstColumn * channels;
+    size_t length = (lastColumn - firstColumn) * channels;
+    const uint8_t* maskRow = layer.mask.ptr<uint8_t>(row) + firstColumn;
+
+    if (Channels != 0)
+        blend::expandAlpha<Channels>(alphaRow, maskRow, lastColumn - firstColumn);
+    else
+        blend::expandAlpha(alphaRow, maskRow, lastColumn - firstColumn, channels);
+
+    if (layer.premultiplied)
+        blend::blendWithAlpha(resultRow + offset, layer.image.ptr<uint8_t>(row) + offset, alphaRow, length);
+    else
+        blend::multiplyAndBlendWithAlpha(resultRow + offset, layer.image.ptr<uint8_t>(row) + offset, alphaRow, length);
+}
+
 #endif
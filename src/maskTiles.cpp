@@ -0,0 +1,74 @@
+#include "maskTiles.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*************/
+MaskTiles::MaskTiles(const cv::Mat& mask, int tileSize)
+{
+    if (mask.type() != CV_8UC1 || tileSize <= 0)
+        return;
+
+    _maskSize = mask.size();
+    _tileSize = tileSize;
+
+    for (int tileY = 0; tileY < mask.rows; tileY += tileSize)
+    {
+        int lastRow = min(tileY + tileSize, mask.rows);
+        vector<Run> runs;
+
+        for (int tileX = 0; tileX < mask.cols; tileX += tileSize)
+        {
+            int lastColumn = min(tileX + tileSize, mask.cols);
+
+            bool hasTransparent = false;
+            bool hasOpaque = false;
+            bool hasPartial = false;
+            for (int y = tileY; y < lastRow && !hasPartial; ++y)
+            {
+                const uint8_t* row = mask.ptr<uint8_t>(y);
+                for (int x = tileX; x < lastColumn; ++x)
+                {
+                    if (row[x] == 0)
+                        hasTransparent = true;
+                    else if (row[x] == 255)
+                        hasOpaque = true;
+                    else
+                        hasPartial = true;
+                }
+            }
+
+            Class type = mixed;
+            if (!hasPartial && !hasOpaque)
+                type = transparent;
+            else if (!hasPartial && !hasTransparent)
+                type = opaque;
+
+            if (runs.size() != 0 && runs.back().type == type)
+                runs.back().lastColumn = lastColumn;
+            else
+                runs.push_back({type, tileX, lastColumn});
+        }
+
+        _runs.push_back(runs);
+    }
+}
+
+/*************/
+float MaskTiles::getCoverage(Class type) const
+{
+    if (_maskSize.area() == 0)
+        return 0.f;
+
+    int area = 0;
+    for (unsigned int tileRow = 0; tileRow < _runs.size(); ++tileRow)
+    {
+        int rows = min(_tileSize, _maskSize.height - static_cast<int>(tileRow) * _tileSize);
+        for (auto& run : _runs[tileRow])
+            if (run.type == type)
+                area += (run.lastColumn - run.firstColumn) * rows;
+    }
+
+    return static_cast<float>(area) / static_cast<float>(_maskSize.area());
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MASKTILES_H
+#define MASKTILES_H
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*************/
+// Classification of the tiles of a mask, as fully transparent, fully opaque or mixed
+// Neighbouring tiles of the same class are merged in horizontal runs
+class MaskTiles
+{
+    public:
+        enum Class : uint8_t
+        {
+            transparent = 0,
+            opaque,
+            mixed
+        };
+
+        struct Run
+        {
+            Class type;
+            int firstColumn;
+            int lastColumn; // Excluded
+        };
+
+        MaskTiles() {}
+        MaskTiles(const cv::Mat& mask, int tileSize = 16);
+
+        explicit operator bool() const
+        {
+            return _tileSize != 0;
+        }
+
+        cv::Size getMaskSize() const {return _maskSize;}
+
+        // Runs covering the whole width of the mask, for the given mask row
+        const std::vector<Run>& getRuns(int row) const {return _runs[row / _tileSize];}
+
+        // Ratio of the mask area covered by tiles of the given class
+        float getCoverage(Class type) const;
+
+    private:
+        cv::Size _maskSize {0, 0};
+        int _tileSize {0};
+        std::vector<std::vector<Run>> _runs {}; // One vector per row of tiles
+};
+
+#endif
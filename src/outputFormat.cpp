@@ -0,0 +1,207 @@
+#include "outputFormat.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace output
+{
+
+/*************/
+// BT.601 limited range, in 8 bits fixed point
+static inline uint8_t getLuma(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t getChromaBlue(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t getChromaRed(int r, int g, int b)
+{
+    return static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/*************/
+template<int Channels>
+static void swapRow(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+        src += Channels;
+        dst += 3;
+    }
+}
+
+/*************/
+template<int Channels>
+static void packRow(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        src += Channels;
+        dst += 3;
+    }
+}
+
+/*************/
+template<int Channels>
+static void yuyvRow(const uint8_t* src, uint8_t* dst, int width)
+{
+    for (int x = 0; x < width; x += 2)
+    {
+        const uint8_t* first = src + x * Channels;
+        const uint8_t* second = x + 1 < width ? first + Channels : first;
+
+        int b = (first[0] + second[0] + 1) >> 1;
+        int g = (first[1] + second[1] + 1) >> 1;
+        int r = (first[2] + second[2] + 1) >> 1;
+
+        dst[0] = getLuma(first[2], first[1], first[0]);
+        dst[1] = getChromaBlue(r, g, b);
+        dst[2] = getLuma(second[2], second[1], second[0]);
+        dst[3] = getChromaRed(r, g, b);
+        dst += 4;
+    }
+}
+
+/*************/
+template<int Channels>
+static void i420Rows(const uint8_t* src, const uint8_t* nextSrc, uint8_t* luma, uint8_t* nextLuma, uint8_t* chromaBlue, uint8_t* chromaRed, int width)
+{
+    for (int x = 0; x < width; ++x)
+    {
+        const uint8_t* pixel = src + x * Channels;
+        const uint8_t* nextPixel = nextSrc + x * Channels;
+        luma[x] = getLuma(pixel[2], pixel[1], pixel[0]);
+        nextLuma[x] = getLuma(nextPixel[2], nextPixel[1], nextPixel[0]);
+    }
+
+    for (int x = 0; x < width; x += 2)
+    {
+        int right = x + 1 < width ? Channels : 0;
+        const uint8_t* pixel = src + x * Channels;
+        const uint8_t* nextPixel = nextSrc + x * Channels;
+
+        int b = (pixel[0] + pixel[right] + nextPixel[0] + nextPixel[right] + 2) >> 2;
+        int g = (pixel[1] + pixel[right + 1] + nextPixel[1] + nextPixel[right + 1] + 2) >> 2;
+        int r = (pixel[2] + pixel[right + 2] + nextPixel[2] + nextPixel[right + 2] + 2) >> 2;
+
+        chromaBlue[x / 2] = getChromaBlue(r, g, b);
+        chromaRed[x / 2] = getChromaRed(r, g, b);
+    }
+}
+
+/*************/
+template<int Channels>
+static void convert(const cv::Mat& frame, uint8_t* dst, Format format, int firstRow, int lastRow)
+{
+    const int width = frame.cols;
+    const int height = frame.rows;
+
+    switch (format)
+    {
+    case Format::rgb24:
+        for (int y = firstRow; y < lastRow; ++y)
+            swapRow<Channels>(frame.ptr<uint8_t>(y), dst + y * width * 3, width);
+        break;
+    case Format::bgr24:
+        for (int y = firstRow; y < lastRow; ++y)
+            packRow<Channels>(frame.ptr<uint8_t>(y), dst + y * width * 3, width);
+        break;
+    case Format::yuyv:
+    {
+        const size_t lineSize = (width + 1) / 2 * 4;
+        for (int y = firstRow; y < lastRow; ++y)
+            yuyvRow<Channels>(frame.ptr<uint8_t>(y), dst + y * lineSize, width);
+        break;
+    }
+    case Format::i420:
+    {
+        const size_t chromaWidth = (width + 1) / 2;
+        const size_t chromaSize = chromaWidth * ((height + 1) / 2);
+        uint8_t* chromaBlue = dst + width * height;
+        uint8_t* chromaRed = chromaBlue + chromaSize;
+
+        // The last row of an odd height frame is paired with itself
+        for (int y = firstRow; y < lastRow; y += 2)
+        {
+            int nextY = min(y + 1, height - 1);
+            uint8_t* luma = dst + y * width;
+            i420Rows<Channels>(frame.ptr<uint8_t>(y), frame.ptr<uint8_t>(nextY), luma, nextY != y ? luma + width : luma, chromaBlue + (y / 2) * chromaWidth,
+                               chromaRed + (y / 2) * chromaWidth, width);
+        }
+        break;
+    }
+    }
+}
+
+/*************/
+string getFormatName(Format format)
+{
+    switch (format)
+    {
+    default:
+    case Format::rgb24:
+        return "rgb24";
+    case Format::bgr24:
+        return "bgr24";
+    case Format::yuyv:
+        return "yuyv";
+    case Format::i420:
+        return "i420";
+    }
+}
+
+/*************/
+bool getFormatFromName(const string& name, Format& format)
+{
+    for (auto candidate : {Format::rgb24, Format::bgr24, Format::yuyv, Format::i420})
+    {
+        if (getFormatName(candidate) == name)
+        {
+            format = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*************/
+size_t getFrameSize(Format format, int width, int height)
+{
+    switch (format)
+    {
+    default:
+    case Format::rgb24:
+    case Format::bgr24:
+        return width * height * 3;
+    case Format::yuyv:
+        return (width + 1) / 2 * 4 * height;
+    case Format::i420:
+        return width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2);
+    }
+}
+
+/*************/
+void convertRows(const cv::Mat& frame, uint8_t* dst, Format format, int firstRow, int lastRow)
+{
+    if (frame.depth() != CV_8U || !dst)
+        return;
+
+    if (frame.channels() == 3)
+        convert<3>(frame, dst, format, firstRow, lastRow);
+    else if (frame.channels() == 4)
+        convert<4>(frame, dst, format, firstRow, lastRow);
+}
+
+} // namespace output
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTPUTFORMAT_H
+#define OUTPUTFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+/*************/
+namespace output
+{
+    // Pixel formats the composited frames can be sent as
+    enum class Format
+    {
+        rgb24,
+        bgr24,
+        yuyv, // Packed 4:2:2, BT.601 limited range
+        i420 // Planar 4:2:0, BT.601 limited range
+    };
+
+    std::string getFormatName(Format format);
+
+    // Returns false if the name matches no format, in which case format is left as is
+    bool getFormatFromName(const std::string& name, Format& format);
+
+    // Size in bytes of a whole frame. Odd sizes get their last chroma sample from a single column or row
+    size_t getFrameSize(Format format, int width, int height);
+
+    // Converts the rows [firstRow, lastRow[ of a BGR or BGRX frame, writing them
+    // at their place in dst which holds the whole converted frame
+    // Rows are converted independently, except for i420 where firstRow must be even
+    // and lastRow even or equal to the frame height, as chroma is shared by row pairs
+    void convertRows(const cv::Mat& frame, uint8_t* dst, Format format, int firstRow, int lastRow);
+}
+
+#endif
@@ -0,0 +1,81 @@
+#include "outputPyramid.h"
+
+#include <opencv2/imgproc.hpp>
+
+using namespace std;
+
+/*************/
+void OutputPyramid::setFrame(const cv::Mat& frame)
+{
+    _frame = frame;
+    if (_levels.size() == 0)
+        _levels.resize(1);
+    _levels[0] = frame;
+    _levelNbr = 1;
+
+    for (auto& scaled : _scaled)
+        scaled.isValid = false;
+}
+
+/*************/
+cv::Mat OutputPyramid::getScaled(cv::Size size)
+{
+    if (_frame.total() == 0 || size.width <= 0 || size.height <= 0)
+        return {};
+
+    if (size == _frame.size())
+        return _frame;
+
+    for (auto& scaled : _scaled)
+        if (scaled.isValid && scaled.image.size() == size)
+            return scaled.image;
+
+    // Start from the smallest level still at least as large as the result
+    unsigned int level = 0;
+    while (true)
+    {
+        cv::Size nextSize((_frame.cols >> (level + 1)), (_frame.rows >> (level + 1)));
+        if (nextSize.width < size.width || nextSize.height < size.height)
+            break;
+        level++;
+    }
+
+    const cv::Mat& source = getLevel(level);
+    if (source.size() == size)
+        return source;
+
+    // Buffers of invalid entries are reused, so nothing is allocated once the outputs are set up
+    Scaled* scaled = nullptr;
+    for (auto& entry : _scaled)
+    {
+        if (!entry.isValid && (!scaled || entry.image.size() == size))
+            scaled = &entry;
+    }
+    if (!scaled)
+    {
+        _scaled.push_back(Scaled());
+        scaled = &_scaled.back();
+    }
+
+    bool isDownscale = size.width <= source.cols && size.height <= source.rows;
+    cv::resize(source, scaled->image, size, 0, 0, isDownscale ? cv::INTER_AREA : cv::INTER_LINEAR);
+    scaled->isValid = true;
+
+    return scaled->image;
+}
+
+/*************/
+const cv::Mat& OutputPyramid::getLevel(unsigned int level)
+{
+    if (_levels.size() <= level)
+        _levels.resize(level + 1);
+
+    // Halving with INTER_AREA averages 2x2 blocks, which is cheap and does not alias
+    for (; _levelNbr <= level; ++_levelNbr)
+    {
+        const cv::Mat& previous = _levels[_levelNbr - 1];
+        cv::resize(previous, _levels[_levelNbr], cv::Size(previous.cols / 2, previous.rows / 2), 0, 0, cv::INTER_AREA);
+    }
+
+    return _levels[level];
+}
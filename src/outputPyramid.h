@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OUTPUTPYRAMID_H
+#define OUTPUTPYRAMID_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*************/
+// Scales a frame to the sizes asked by the outputs, each size being computed once per frame
+// Small sizes are computed from successive halvings of the frame, so each
+// resize reads a frame at most twice as large as its result
+class OutputPyramid
+{
+    public:
+        // Set the frame of the current iteration, which invalidates the scaled frames
+        void setFrame(const cv::Mat& frame);
+
+        // Get the frame at the given size. The result is overwritten on the next frame
+        cv::Mat getScaled(cv::Size size);
+
+        unsigned int getLevelNbr() const {return _levelNbr;}
+
+    private:
+        cv::Mat _frame {};
+
+        // Level i is the frame halved i times, level 0 being the frame itself
+        std::vector<cv::Mat> _levels {};
+        unsigned int _levelNbr {1}; // Levels computed for the current frame
+
+        struct Scaled
+        {
+            cv::Mat image {};
+            bool isValid {false};
+        };
+        std::vector<Scaled> _scaled {};
+
+        // Compute levels up to the given one
+        const cv::Mat& getLevel(unsigned int level);
+};
+
+#endif
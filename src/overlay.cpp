@@ -0,0 +1,179 @@
+#include "overlay.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include <opencv2/imgproc.hpp>
+
+#include "./blendKernels.h"
+
+using namespace std;
+
+/*************/
+void Overlay::addRegions(cv::Mat& frame, const cv::Mat& src, const vector<cv::Rect>& regions, int firstRow, int lastRow)
+{
+    size_t pixelSize = frame.elemSize();
+    for (auto& region : regions)
+        for (int y = max(region.y, firstRow); y < min(region.y + region.height, lastRow); ++y)
+            blend::addSaturate(frame.ptr<uint8_t>(y) + region.x * pixelSize, src.ptr<uint8_t>(y) + region.x * pixelSize, region.width * pixelSize);
+}
+
+/*************/
+void Overlay::doubleRegions(cv::Mat& frame, const vector<cv::Rect>& regions, int firstRow, int lastRow)
+{
+    size_t pixelSize = frame.elemSize();
+    for (auto& region : regions)
+    {
+        for (int y = max(region.y, firstRow); y < min(region.y + region.height, lastRow); ++y)
+        {
+            uint8_t* row = frame.ptr<uint8_t>(y) + region.x * pixelSize;
+            blend::addSaturate(row, row, region.width * pixelSize);
+        }
+    }
+}
+
+/*************/
+LogoOverlay::LogoOverlay(const cv::Mat& logo, double attenuation)
+{
+    _logo = logo;
+    _attenuation = attenuation;
+}
+
+/*************/
+void LogoOverlay::prepare(const cv::Mat& frame)
+{
+    if (_logo.total() == 0)
+        return;
+
+    updateCache(frame.size(), frame.type());
+}
+
+/*************/
+void LogoOverlay::apply(cv::Mat& frame, int firstRow, int lastRow)
+{
+    if (_cachedLogo.size() != frame.size() || _cachedLogo.type() != frame.type())
+        return;
+
+    addRegions(frame, _cachedLogo, _regions, firstRow, lastRow);
+}
+
+/*************/
+void LogoOverlay::updateCache(cv::Size frameSize, int type)
+{
+    if (_cacheSize == frameSize && _cachedLogo.type() == type)
+        return;
+
+    _cacheSize = frameSize;
+    if (_logo.size() != frameSize)
+        cv::resize(_logo, _cachedLogo, frameSize, 0, 0, cv::INTER_LINEAR);
+    else
+        _logo.copyTo(_cachedLogo);
+    _cachedLogo.convertTo(_cachedLogo, -1, _attenuation);
+
+    // Padded frames get a logo with a black padding byte
+    if (CV_MAT_CN(type) == 4)
+    {
+        cv::Mat paddedLogo = cv::Mat::zeros(frameSize, type);
+        cv::mixChannels(_cachedLogo, paddedLogo, {0, 0, 1, 1, 2, 2});
+        _cachedLogo = paddedLogo;
+    }
+
+    // Look for the tiles holding non-black pixels, and merge them in horizontal runs
+    _regions.clear();
+    size_t pixelSize = _cachedLogo.elemSize();
+    for (int tileY = 0; tileY < frameSize.height; tileY += _tileSize)
+    {
+        int tileHeight = min(_tileSize, frameSize.height - tileY);
+        int runStart = -1;
+
+        // One more iteration past the right border closes the last run
+        for (int tileX = 0; tileX < frameSize.width + _tileSize; tileX += _tileSize)
+        {
+            bool isEmpty = true;
+            if (tileX < frameSize.width)
+            {
+                int tileWidth = min(_tileSize, frameSize.width - tileX);
+                for (int y = tileY; y < tileY + tileHeight && isEmpty; ++y)
+                {
+                    const uint8_t* row = _cachedLogo.ptr<uint8_t>(y) + tileX * pixelSize;
+                    for (size_t i = 0; i < tileWidth * pixelSize; ++i)
+                    {
+                        if (row[i] != 0)
+                        {
+                            isEmpty = false;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (!isEmpty && runStart < 0)
+            {
+                runStart = tileX;
+            }
+            else if (isEmpty && runStart >= 0)
+            {
+                _regions.push_back(cv::Rect(runStart, tileY, min(tileX, frameSize.width) - runStart, tileHeight));
+                runStart = -1;
+            }
+        }
+    }
+
+    cout << "LogoOverlay: logo cached at " << frameSize.width << "x" << frameSize.height << ", with " << _regions.size() << " region(s) to draw" << endl;
+}
+
+/*************/
+ProgressBarOverlay::ProgressBarOverlay(int height, cv::Scalar color)
+{
+    _height = height;
+    _color = color;
+}
+
+/*************/
+void ProgressBarOverlay::prepare(const cv::Mat& frame)
+{
+    int width = static_cast<int>(frame.cols * max(0.f, min(1.f, _progress)));
+    int height = min(_height, frame.rows);
+    _region = cv::Rect(frame.cols - width, frame.rows - height, width, height);
+    if (_region.area() == 0)
+        return;
+
+    if (_colorRow.cols != frame.cols || _colorRow.type() != frame.type())
+        _colorRow = cv::Mat(1, frame.cols, frame.type(), _color);
+}
+
+/*************/
+void ProgressBarOverlay::apply(cv::Mat& frame, int firstRow, int lastRow)
+{
+    if (_region.area() == 0 || _colorRow.cols != frame.cols || _colorRow.type() != frame.type())
+        return;
+
+    // The same color row is added to every row of the bar
+    size_t pixelSize = frame.elemSize();
+    for (int y = max(_region.y, firstRow); y < min(_region.y + _region.height, lastRow); ++y)
+        blend::addSaturate(frame.ptr<uint8_t>(y) + _region.x * pixelSize, _colorRow.ptr<uint8_t>(0) + _region.x * pixelSize, _region.width * pixelSize);
+}
+
+/*************/
+void FlashOverlay::prepare(const cv::Mat& frame)
+{
+    _regions.clear();
+    if (!_triggered)
+        return;
+    _triggered = false;
+
+    int margin = min(_margin, min(frame.cols, frame.rows) / 2);
+    if (margin <= 0)
+        return;
+
+    _regions = {cv::Rect(0, 0, frame.cols, margin),
+                cv::Rect(0, frame.rows - margin, frame.cols, margin),
+                cv::Rect(0, margin, margin, frame.rows - margin * 2),
+                cv::Rect(frame.cols - margin, margin, margin, frame.rows - margin * 2)};
+}
+
+/*************/
+void FlashOverlay::apply(cv::Mat& frame, int firstRow, int lastRow)
+{
+    doubleRegions(frame, _regions, firstRow, lastRow);
+}
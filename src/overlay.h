@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*************/
+// An overlay modifies a composited frame in place, and only touches the
+// rectangles it covers so that its cost depends on its area
+// It is applied band by band, so that it can be fused with the compositing
+class Overlay
+{
+    public:
+        virtual ~Overlay() {}
+
+        // Called once per frame before any band is applied, from the calling thread
+        virtual void prepare(const cv::Mat& frame) {}
+
+        // Apply to the rows [firstRow, lastRow[ of frame
+        // Can be called concurrently for disjoint bands of the same frame
+        virtual void apply(cv::Mat& frame, int firstRow, int lastRow) = 0;
+
+        // Prepare and apply to the whole frame
+        void apply(cv::Mat& frame)
+        {
+            prepare(frame);
+            apply(frame, 0, frame.rows);
+        }
+
+    protected:
+        // Add the given rectangles of src to the same rectangles of frame, with saturation
+        static void addRegions(cv::Mat& frame, const cv::Mat& src, const std::vector<cv::Rect>& regions, int firstRow, int lastRow);
+
+        // Double the values of frame in the given rectangles, with saturation
+        static void doubleRegions(cv::Mat& frame, const std::vector<cv::Rect>& regions, int firstRow, int lastRow);
+};
+
+/*************/
+// Adds an attenuated logo over the frame
+class LogoOverlay : public Overlay
+{
+    public:
+        LogoOverlay(const cv::Mat& logo, double attenuation = 0.35);
+
+        using Overlay::apply;
+        void prepare(const cv::Mat& frame);
+        void apply(cv::Mat& frame, int firstRow, int lastRow);
+
+    private:
+        static const int _tileSize = 16;
+
+        cv::Mat _logo;
+        double _attenuation {1.0};
+
+        // Logo scaled to the frame size and attenuated, with the regions where it is not black
+        cv::Size _cacheSize {0, 0};
+        cv::Mat _cachedLogo {};
+        std::vector<cv::Rect> _regions {};
+
+        // Rebuild the logo cache if the frame size or type changed
+        void updateCache(cv::Size frameSize, int type);
+};
+
+/*************/
+// Adds a bar along the bottom of the frame, growing from the right as the mirrored frame is seen from the other side
+class ProgressBarOverlay : public Overlay
+{
+    public:
+        ProgressBarOverlay(int height = 16, cv::Scalar color = cv::Scalar(255, 64, 64));
+
+        using Overlay::apply;
+        void prepare(const cv::Mat& frame);
+        void apply(cv::Mat& frame, int firstRow, int lastRow);
+
+        // Progress from 0 to 1
+        void setProgress(float progress) {_progress = progress;}
+
+    private:
+        int _height {16};
+        cv::Scalar _color;
+        float _progress {0.f};
+
+        cv::Mat _colorRow {}; // A row filled with the bar color, at the frame width
+        cv::Rect _region {}; // Covered by the bar in the current frame
+};
+
+/*************/
+// Brightens the borders of the frame, for a single frame once triggered
+class FlashOverlay : public Overlay
+{
+    public:
+        FlashOverlay(int margin = 16) : _margin(margin) {}
+
+        using Overlay::apply;
+        void prepare(const cv::Mat& frame);
+        void apply(cv::Mat& frame, int firstRow, int lastRow);
+
+        void setMargin(int margin) {_margin = margin;}
+        void trigger() {_triggered = true;}
+
+    private:
+        int _margin {16};
+        bool _triggered {false};
+        std::vector<cv::Rect> _regions {}; // Borders to flash in the current frame, empty if not triggered
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "shmOutput.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+static_assert(sizeof(shm::ShmHeader) <= shm::headerSize, "ShmOutput: header does not fit in its padding");
+static_assert(sizeof(shm::ShmSlotHeader) <= shm::slotHeaderSize, "ShmOutput: slot header does not fit in its padding");
+
+/*************/
+ShmOutput::ShmOutput(int width, int height, string name, output::Format format, unsigned int slotNbr)
+{
+    _name = "/" + name;
+    _width = width;
+    _height = height;
+    _format = format;
+    _frameSize = output::getFrameSize(format, width, height);
+    _slotNbr = max(2u, slotNbr);
+    _slotStride = shm::getSlotStride(_frameSize);
+    _segmentSize = shm::headerSize + _slotNbr * _slotStride;
+
+    // A previous segment of the same name is replaced, readers will reopen it when the header changes
+    shm_unlink(_name.c_str());
+    int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        cout << "ShmOutput: unable to create shared memory " << _name << ": " << strerror(errno) << endl;
+        return;
+    }
+
+    if (ftruncate(fd, _segmentSize) < 0)
+    {
+        cout << "ShmOutput: unable to resize shared memory " << _name << ": " << strerror(errno) << endl;
+        close(fd);
+        shm_unlink(_name.c_str());
+        return;
+    }
+
+    void* segment = mmap(nullptr, _segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+    {
+        cout << "ShmOutput: unable to map shared memory " << _name << ": " << strerror(errno) << endl;
+        shm_unlink(_name.c_str());
+        return;
+    }
+    _segment = static_cast<uint8_t*>(segment);
+
+    // A new segment is zeroed, so only the non zero fields are set
+    auto header = getHeader();
+    memcpy(header->magic, shm::magic, sizeof(shm::magic));
+    header->version = shm::version;
+    header->slotNbr = _slotNbr;
+    header->slotSize = _frameSize;
+    header->slotStride = _slotStride;
+    header->latestSlot.store(_slotNbr, memory_order_release);
+
+    for (unsigned int i = 0; i < _slotNbr; ++i)
+        _freeSlots.push_back(i);
+
+    cout << "ShmOutput: publishing " << width << "x" << height << " " << output::getFormatName(format) << " frames in " << _name << ", " << _slotNbr
+         << " slots" << endl;
+}
+
+/*************/
+ShmOutput::~ShmOutput()
+{
+    if (!_segment)
+        return;
+
+    munmap(_segment, _segmentSize);
+    shm_unlink(_name.c_str());
+}
+
+/*************/
+bool ShmOutput::writeToDevice(void* data, size_t size)
+{
+    if (size != _frameSize)
+        return false;
+
+    uint8_t* slot = acquireBuffer();
+    if (!slot)
+        return false;
+
+    memcpy(slot, data, size);
+    return queueBuffer(slot);
+}
+
+/*************/
+uint8_t* ShmOutput::acquireBuffer(bool wait)
+{
+    if (!_segment)
+        return nullptr;
+
+    unsigned int slot;
+    {
+        lock_guard<mutex> lock(_slotMutex);
+        if (_freeSlots.size() == 0)
+            return nullptr;
+
+        // The oldest published slot comes first, so the latest one is overwritten last
+        slot = _freeSlots.front();
+        _freeSlots.pop_front();
+    }
+
+    // Readers of this slot will see it is being written
+    auto slotHeader = getSlotHeader(slot);
+    uint32_t sequence = slotHeader->sequence.load(memory_order_relaxed);
+    if (sequence % 2 == 0)
+        slotHeader->sequence.store(sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    return getSlotData(slot);
+}
+
+/*************/
+bool ShmOutput::queueBuffer(const uint8_t* data)
+{
+    int slot = getSlotIndex(data);
+    if (slot < 0)
+        return false;
+
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    auto slotHeader = getSlotHeader(slot);
+    slotHeader->format = static_cast<uint32_t>(_format);
+    slotHeader->frameNumber = ++_frameNumber;
+    slotHeader->timestamp = static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+    slotHeader->width = _width;
+    slotHeader->height = _height;
+    slotHeader->size = _frameSize;
+
+    // Back to an even sequence, which publishes the frame and the fields above
+    uint32_t sequence = slotHeader->sequence.load(memory_order_relaxed);
+    slotHeader->sequence.store(sequence + 1, memory_order_release);
+    getHeader()->latestSlot.store(slot, memory_order_release);
+
+    lock_guard<mutex> lock(_slotMutex);
+    _freeSlots.push_back(slot);
+    return true;
+}
+
+/*************/
+void ShmOutput::releaseBuffer(const uint8_t* data)
+{
+    int slot = getSlotIndex(data);
+    if (slot < 0)
+        return;
+
+    // The slot may hold a partly written frame, so it stays marked as being written
+    // until the next time it is published. It goes first, to be reused next
+    lock_guard<mutex> lock(_slotMutex);
+    _freeSlots.push_front(slot);
+}
+
+/*************/
+bool ShmOutput::isDeviceBuffer(const uint8_t* data) const
+{
+    return getSlotIndex(data) >= 0;
+}
+
+/*************/
+shm::ShmSlotHeader* ShmOutput::getSlotHeader(unsigned int slot) const
+{
+    return reinterpret_cast<shm::ShmSlotHeader*>(_segment + shm::headerSize + slot * _slotStride);
+}
+
+/*************/
+uint8_t* ShmOutput::getSlotData(unsigned int slot) const
+{
+    return _segment + shm::headerSize + slot * _slotStride + shm::slotHeaderSize;
+}
+
+/*************/
+int ShmOutput::getSlotIndex(const uint8_t* data) const
+{
+    if (!_segment)
+        return -1;
+
+    for (unsigned int i = 0; i < _slotNbr; ++i)
+        if (getSlotData(i) == data)
+            return i;
+    return -1;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHMOUTPUT_H
+#define SHMOUTPUT_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+#include "./frameSink.h"
+#include "./outputFormat.h"
+
+/*************/
+// Layout of the shared memory, for the readers
+// The segment starts with a ShmHeader padded to 64 bytes, followed by slotNbr slots
+// made of a ShmSlotHeader padded to 64 bytes then slotSize bytes of frame
+namespace shm
+{
+    static const char magic[8] = {'G', 'I', 'F', 'B', 'O', 'X', 'F', 'R'};
+    static const uint32_t version = 1;
+
+    struct ShmHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t slotNbr;
+        uint64_t slotSize; // Bytes of frame data per slot
+        uint64_t slotStride; // Bytes from a slot header to the next
+        std::atomic<uint64_t> latestSlot; // Slot of the last published frame, or slotNbr if none
+    };
+
+    // Seqlock: sequence is odd while the slot is being written. A reader copies the
+    // fields it needs, or works on the data in place, then checks that sequence did not change
+    struct ShmSlotHeader
+    {
+        std::atomic<uint32_t> sequence;
+        uint32_t format; // output::Format
+        uint64_t frameNumber; // Starts at 1
+        uint64_t timestamp; // CLOCK_MONOTONIC, in nanoseconds
+        uint32_t width;
+        uint32_t height;
+        uint64_t size; // Bytes of frame data
+    };
+
+    static const size_t headerSize = 64;
+    static const size_t slotHeaderSize = 64;
+
+    inline size_t getSlotStride(size_t slotSize)
+    {
+        return slotHeaderSize + (slotSize + 63) / 64 * 64;
+    }
+}
+
+/*************/
+// Publishes frames in a POSIX shared memory ring, for local readers
+// Frames are converted straight into the ring slots, so neither side copies them
+class ShmOutput : public FrameSink
+{
+    public:
+        // The segment is created as /name, and removed on destruction
+        ShmOutput(int width, int height, std::string name = "gifbox", output::Format format = output::Format::rgb24, unsigned int slotNbr = 4);
+        ~ShmOutput();
+
+        explicit operator bool() const {return _segment != nullptr;}
+
+        bool writeToDevice(void* data, size_t size);
+
+        // Slots not acquired yet are reused from the oldest published one
+        // Waiting is never needed, as only the writer holds slots
+        uint8_t* acquireBuffer(bool wait = true);
+        bool queueBuffer(const uint8_t* data);
+        void releaseBuffer(const uint8_t* data);
+        bool isDeviceBuffer(const uint8_t* data) const;
+
+        bool isStreaming() {return true;}
+
+    private:
+        std::string _name {};
+        uint8_t* _segment {nullptr};
+        size_t _segmentSize {0};
+        unsigned int _slotNbr {0};
+        size_t _slotStride {0};
+        uint64_t _frameNumber {0};
+
+        std::mutex _slotMutex {};
+        std::deque<unsigned int> _freeSlots {}; // Oldest published first
+
+        shm::ShmHeader* getHeader() const {return reinterpret_cast<shm::ShmHeader*>(_segment);}
+        shm::ShmSlotHeader* getSlotHeader(unsigned int slot) const;
+        uint8_t* getSlotData(unsigned int slot) const;
+
+        // Index of the slot whose data starts at data, -1 if none
+        int getSlotIndex(const uint8_t* data) const;
+};
+
+#endif
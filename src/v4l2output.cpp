@@ -6,16 +6,66 @@
 using namespace std;
 
 /*************/
-V4l2Output::V4l2Output(int width, int height, string device)
+static uint32_t getPixelFormat(output::Format format)
+{
+    switch (format)
+    {
+    default:
+    case output::Format::rgb24:
+        return V4L2_PIX_FMT_RGB24;
+    case output::Format::bgr24:
+        return V4L2_PIX_FMT_BGR24;
+    case output::Format::yuyv:
+        return V4L2_PIX_FMT_YUYV;
+    case output::Format::i420:
+        return V4L2_PIX_FMT_YUV420;
+    }
+}
+
+/*************/
+// Bytes per line of the first plane, as the conversions write it
+static uint32_t getBytesPerLine(output::Format format, int width)
+{
+    switch (format)
+    {
+    default:
+    case output::Format::rgb24:
+    case output::Format::bgr24:
+        return width * 3;
+    case output::Format::yuyv:
+        return (width + 1) / 2 * 4;
+    case output::Format::i420:
+        return width;
+    }
+}
+
+/*************/
+static string getFourcc(uint32_t pixelFormat)
+{
+    string fourcc;
+    for (int i = 0; i < 4; ++i)
+        fourcc += static_cast<char>((pixelFormat >> (i * 8)) & 0xFF);
+    return fourcc;
+}
+
+/*************/
+V4l2Output::V4l2Output(int width, int height, string device, output::Format format, bool streaming)
 {
     _device = device;
-    _sink = open(device.c_str(), O_WRONLY);
+    _format = format;
+    // Mapping the buffers for writing needs read access too
+    // Writes and dequeues do not block, to be able to give up on a stalled consumer
+    _sink = open(device.c_str(), (streaming ? O_RDWR : O_WRONLY) | O_NONBLOCK);
     if (_sink < 0)
     {
         cout << "Unable to open v4l2 loopback device: " << _device << endl;
         return;
     }
 
+    _wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeup < 0)
+        cout << "V4l2Output: unable to create the wake-up eventfd, waits will be interrupted after " << _pollTimeout << " ms: " << strerror(errno) << endl;
+
     struct v4l2_format v4l2format;
     v4l2format.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
     if (ioctl(_sink, VIDIOC_G_FMT, &v4l2format))
@@ -26,9 +76,11 @@ V4l2Output::V4l2Output(int width, int height, string device)
 
     v4l2format.fmt.pix.width = width;
     v4l2format.fmt.pix.height = height;
-    v4l2format.fmt.pix.pixelformat = V4L2_PIX_FMT_RGB24;
-    v4l2format.fmt.pix.sizeimage = width * height * 3;
-    if (ioctl(_sink, VIDIOC_S_FMT, v4l2format) < 0)
+    v4l2format.fmt.pix.pixelformat = getPixelFormat(format);
+    v4l2format.fmt.pix.field = V4L2_FIELD_NONE;
+    v4l2format.fmt.pix.bytesperline = 0; // Let the driver compute it
+    v4l2format.fmt.pix.sizeimage = output::getFrameSize(format, width, height);
+    if (ioctl(_sink, VIDIOC_S_FMT, &v4l2format) < 0)
     {
         cout << "Error while setting v4l2 loopback device format: " << strerror(errno) << endl;
         return;
@@ -36,28 +88,276 @@ V4l2Output::V4l2Output(int width, int height, string device)
 
     _width = width;
     _height = height;
-    
-    cout << "V4L2 loopback device successfully opened" << endl;
+
+    // The driver may have adjusted the format, which the frames would not match
+    // The size is kept anyway, so that the output is not opened again for each frame
+    auto& pix = v4l2format.fmt.pix;
+    uint32_t bytesPerLine = getBytesPerLine(format, width);
+    if (pix.pixelformat != getPixelFormat(format) || pix.width != static_cast<uint32_t>(width) || pix.height != static_cast<uint32_t>(height)
+        || (pix.bytesperline != 0 && pix.bytesperline != bytesPerLine))
+    {
+        cout << "V4l2Output: device " << _device << " does not support " << width << "x" << height << " " << getFourcc(getPixelFormat(format)) << " with "
+             << bytesPerLine << " bytes per line, it set " << pix.width << "x" << pix.height << " " << getFourcc(pix.pixelformat) << " with "
+             << pix.bytesperline << " bytes per line. The output is disabled" << endl;
+        close(_sink);
+        _sink = -1;
+        return;
+    }
+
+    _frameSize = output::getFrameSize(format, width, height);
+
+    if (streaming)
+        _streaming = initStreaming();
+
+    cout << "V4L2 loopback device successfully opened, sending " << output::getFormatName(format) << (_streaming ? " through mmap'd buffers" : "") << endl;
 }
 
 /*************/
 V4l2Output::~V4l2Output()
 {
+    releaseStreaming();
+
     if (_sink >= 0)
         close(_sink);
+    if (_wakeup >= 0)
+        close(_wakeup);
 }
 
 /*************/
-bool V4l2Output::writeToDevice(void* data, size_t size)
+bool V4l2Output::initStreaming()
 {
-    if (_sink < 0)
+    struct v4l2_requestbuffers request;
+    memset(&request, 0, sizeof(request));
+    request.count = _bufferNbr;
+    request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    request.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(_sink, VIDIOC_REQBUFS, &request) < 0 || request.count == 0)
+    {
+        cout << "V4l2Output: device does not support mmap streaming, falling back to write: " << strerror(errno) << endl;
         return false;
+    }
+
+    for (unsigned int i = 0; i < request.count; ++i)
+    {
+        struct v4l2_buffer buffer;
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buffer.memory = V4L2_MEMORY_MMAP;
+        buffer.index = i;
+        if (ioctl(_sink, VIDIOC_QUERYBUF, &buffer) < 0)
+        {
+            cout << "V4l2Output: error while querying buffer " << i << ": " << strerror(errno) << endl;
+            releaseStreaming();
+            return false;
+        }
+
+        void* data = mmap(nullptr, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, _sink, buffer.m.offset);
+        if (data == MAP_FAILED || buffer.length < _frameSize)
+        {
+            cout << "V4l2Output: error while mapping buffer " << i << endl;
+            if (data != MAP_FAILED)
+                munmap(data, buffer.length);
+            releaseStreaming();
+            return false;
+        }
+
+        Buffer mappedBuffer;
+        mappedBuffer.data = static_cast<uint8_t*>(data);
+        mappedBuffer.length = buffer.length;
+        _buffers.push_back(mappedBuffer);
+        _freeBuffers.push_back(i);
+    }
+
+    return true;
+}
+
+/*************/
+void V4l2Output::releaseStreaming()
+{
+    if (_streamOn)
+    {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        ioctl(_sink, VIDIOC_STREAMOFF, &type);
+        _streamOn = false;
+    }
+
+    for (auto& buffer : _buffers)
+        munmap(buffer.data, buffer.length);
+    _buffers.clear();
+    _freeBuffers.clear();
+
+    // Free the buffers on the driver side too
+    if (_sink >= 0)
+    {
+        struct v4l2_requestbuffers request;
+        memset(&request, 0, sizeof(request));
+        request.count = 0;
+        request.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        request.memory = V4L2_MEMORY_MMAP;
+        ioctl(_sink, VIDIOC_REQBUFS, &request);
+    }
+}
+
+/*************/
+uint8_t* V4l2Output::acquireBuffer(bool wait)
+{
+    if (!_streaming)
+        return nullptr;
 
-    if ((int)size != write(_sink, data, size))
     {
-        cout << "Error while sending frame" << endl;
+        lock_guard<mutex> lock(_bufferMutex);
+        if (_freeBuffers.size() != 0)
+        {
+            unsigned int index = _freeBuffers.back();
+            _freeBuffers.pop_back();
+            return _buffers[index].data;
+        }
+    }
+
+    if (!wait)
+        return nullptr;
+
+    // All buffers are queued, wait for the device to give one back
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    while (ioctl(_sink, VIDIOC_DQBUF, &buffer) < 0)
+    {
+        if (errno != EAGAIN)
+        {
+            cout << "V4l2Output: error while dequeuing buffer: " << strerror(errno) << endl;
+            return nullptr;
+        }
+
+        if (!waitForDevice())
+            return nullptr;
+    }
+
+    return _buffers[buffer.index].data;
+}
+
+/*************/
+void V4l2Output::interrupt()
+{
+    _interrupted = true;
+
+    uint64_t value = 1;
+    if (_wakeup >= 0 && write(_wakeup, &value, sizeof(value)) != sizeof(value))
+        cout << "V4l2Output: unable to wake up the waiting thread: " << strerror(errno) << endl;
+}
+
+/*************/
+bool V4l2Output::waitForDevice()
+{
+    if (_interrupted)
+        return false;
+
+    struct pollfd fds[2];
+    fds[0].fd = _sink;
+    fds[0].events = POLLOUT;
+    fds[1].fd = _wakeup;
+    fds[1].events = POLLIN;
+    if (poll(fds, _wakeup >= 0 ? 2 : 1, _pollTimeout) < 0 && errno != EINTR)
+    {
+        cout << "V4l2Output: error while waiting for the device: " << strerror(errno) << endl;
         return false;
     }
 
+    return !_interrupted;
+}
+
+/*************/
+bool V4l2Output::queueBuffer(const uint8_t* data)
+{
+    int index = getBufferIndex(data);
+    if (!_streaming || index < 0)
+        return false;
+
+    struct v4l2_buffer buffer;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buffer.memory = V4L2_MEMORY_MMAP;
+    buffer.index = index;
+    buffer.bytesused = _frameSize;
+    buffer.field = V4L2_FIELD_NONE;
+    if (ioctl(_sink, VIDIOC_QBUF, &buffer) < 0)
+    {
+        cout << "V4l2Output: error while queuing buffer: " << strerror(errno) << endl;
+        releaseBuffer(data);
+        return false;
+    }
+
+    if (!_streamOn)
+    {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (ioctl(_sink, VIDIOC_STREAMON, &type) < 0)
+        {
+            cout << "V4l2Output: error while starting the stream: " << strerror(errno) << endl;
+            return false;
+        }
+        _streamOn = true;
+    }
+
     return true;
 }
+
+/*************/
+void V4l2Output::releaseBuffer(const uint8_t* data)
+{
+    int index = getBufferIndex(data);
+    if (index < 0)
+        return;
+
+    lock_guard<mutex> lock(_bufferMutex);
+    _freeBuffers.push_back(index);
+}
+
+/*************/
+bool V4l2Output::isDeviceBuffer(const uint8_t* data) const
+{
+    return getBufferIndex(data) >= 0;
+}
+
+/*************/
+int V4l2Output::getBufferIndex(const uint8_t* data) const
+{
+    for (unsigned int i = 0; i < _buffers.size(); ++i)
+        if (_buffers[i].data == data)
+            return i;
+    return -1;
+}
+
+/*************/
+bool V4l2Output::writeToDevice(void* data, size_t size)
+{
+    if (_sink < 0)
+        return false;
+
+    if (_streaming)
+    {
+        if (size != _frameSize)
+            return false;
+        uint8_t* buffer = acquireBuffer();
+        if (!buffer)
+            return false;
+        memcpy(buffer, data, size);
+        return queueBuffer(buffer);
+    }
+
+    while (true)
+    {
+        ssize_t written = write(_sink, data, size);
+        if (written == static_cast<ssize_t>(size))
+            return true;
+
+        if (written >= 0 || errno != EAGAIN)
+        {
+            cout << "Error while sending frame" << endl;
+            return false;
+        }
+
+        if (!waitForDevice())
+            return false;
+    }
+}
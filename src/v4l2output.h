@@ -22,19 +22,30 @@
 #define V4L2OUTPUT_H
 
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <linux/videodev2.h>
 
+#include "./frameSink.h"
+#include "./outputFormat.h"
+
 /*************/
-class V4l2Output
+class V4l2Output : public FrameSink
 {
     public:
-        V4l2Output(int width, int height, std::string device = "/dev/video0");
+        // With streaming set, frames are sent through mmap'd device buffers instead of write()
+        // If the device does not support it, write() is used instead
+        V4l2Output(int width, int height, std::string device = "/dev/video0", output::Format format = output::Format::rgb24, bool streaming = false);
         ~V4l2Output();
 
         explicit operator bool() const
@@ -47,14 +58,49 @@ class V4l2Output
 
         bool writeToDevice(void* data, size_t size);
 
-        inline int getWidth() {return _width;}
-        inline int getHeight() {return _height;}
+        // Streaming mode only, see FrameSink. When all buffers are queued, waiting
+        // for a buffer means waiting for the device to give one back
+        uint8_t* acquireBuffer(bool wait = true);
+        bool queueBuffer(const uint8_t* data);
+        void releaseBuffer(const uint8_t* data);
+        bool isDeviceBuffer(const uint8_t* data) const;
+
+        bool isStreaming() {return _streaming;}
+        bool needsBufferReclaim() {return _streaming;}
+
+        // The device is opened non-blocking, waits being done with poll so that they can be interrupted
+        void interrupt();
 
     private:
-        int _width {0};
-        int _height {0};
         std::string _device {};
         int _sink {-1};
+        int _wakeup {-1}; // eventfd written by interrupt
+        std::atomic<bool> _interrupted {false};
+        static const int _pollTimeout = 100; // In milliseconds, in case the wake-up is missed
+
+        static const unsigned int _bufferNbr = 3;
+        struct Buffer
+        {
+            uint8_t* data {nullptr};
+            size_t length {0};
+        };
+
+        bool _streaming {false};
+        bool _streamOn {false};
+        std::vector<Buffer> _buffers {};
+        std::mutex _bufferMutex {};
+        std::vector<unsigned int> _freeBuffers {}; // Never queued, or dequeued and not acquired yet
+
+        // Request and map the device buffers, returns false if streaming is not supported
+        bool initStreaming();
+        void releaseStreaming();
+
+        // Wait for the device to accept a frame or to give a buffer back
+        // Returns false if interrupted, or on error
+        bool waitForDevice();
+
+        // Index of the device buffer starting at data, -1 if none
+        int getBufferIndex(const uint8_t* data) const;
 };
 
 #endif
@@ -0,0 +1,100 @@
+#include "workerPool.h"
+
+using namespace std;
+
+/*************/
+WorkerPool::WorkerPool(unsigned int threadNbr)
+{
+    for (unsigned int i = 1; i < threadNbr; ++i)
+        _workers.emplace_back([&]() {
+            work();
+        });
+}
+
+/*************/
+WorkerPool::~WorkerPool()
+{
+    {
+        unique_lock<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _workCondition.notify_all();
+
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+/*************/
+void WorkerPool::run(unsigned int taskNbr, const function<void(unsigned int)>& task)
+{
+    if (taskNbr == 0)
+        return;
+
+    if (_workers.size() == 0 || taskNbr == 1)
+    {
+        for (unsigned int i = 0; i < taskNbr; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        // Late workers from the previous run may still be leaving
+        unique_lock<mutex> lock(_mutex);
+        _doneCondition.wait(lock, [&]() {return _activeWorkers == 0;});
+
+        _task = &task;
+        _taskNbr = taskNbr;
+        _nextTask = 0;
+        _remainingTasks = taskNbr;
+        _generation++;
+    }
+    _workCondition.notify_all();
+
+    processTasks();
+
+    unique_lock<mutex> lock(_mutex);
+    _doneCondition.wait(lock, [&]() {return _remainingTasks == 0 && _activeWorkers == 0;});
+    _task = nullptr;
+}
+
+/*************/
+void WorkerPool::work()
+{
+    uint64_t generation = 0;
+
+    while (true)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _workCondition.wait(lock, [&]() {return _stop || _generation != generation;});
+            if (_stop)
+                return;
+
+            generation = _generation;
+            _activeWorkers++;
+        }
+
+        processTasks();
+
+        {
+            unique_lock<mutex> lock(_mutex);
+            _activeWorkers--;
+        }
+        _doneCondition.notify_all();
+    }
+}
+
+/*************/
+void WorkerPool::processTasks()
+{
+    unsigned int index;
+    while ((index = _nextTask++) < _taskNbr)
+    {
+        (*_task)(index);
+        if (--_remainingTasks == 0)
+        {
+            unique_lock<mutex> lock(_mutex);
+            _doneCondition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2015 Emmanuel Durand
+ *
+ * This file is part of GifBox.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GifBox is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with GifBox.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*************/
+class WorkerPool
+{
+    public:
+        // The calling thread takes part in the work, so threadNbr - 1 workers are spawned
+        WorkerPool(unsigned int threadNbr);
+        ~WorkerPool();
+
+        unsigned int getThreadNbr() const {return _workers.size() + 1;}
+
+        // Run task(index) for every index in [0, taskNbr), and return once all are done
+        void run(unsigned int taskNbr, const std::function<void(unsigned int)>& task);
+
+    private:
+        std::vector<std::thread> _workers;
+        std::mutex _mutex;
+        std::condition_variable _workCondition;
+        std::condition_variable _doneCondition;
+
+        bool _stop {false};
+        uint64_t _generation {0};
+        unsigned int _activeWorkers {0};
+
+        const std::function<void(unsigned int)>* _task {nullptr};
+        unsigned int _taskNbr {0};
+        std::atomic<unsigned int> _nextTask {0};
+        std::atomic<unsigned int> _remainingTasks {0};
+
+        void work();
+        void processTasks();
+};
+
+#endif
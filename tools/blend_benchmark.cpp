@@ -0,0 +1,243 @@
+/*
+ * Micro-benchmark for the alpha blending kernels used by LayerMerger
+ * Checks that every kernel supported by the CPU gives the same output
+ * as the reference per-pixel loop, and measures their speed
+ *
+ * With --validate, every kernel is instead checked against the integer
+ * division for all 256x256x256 combinations of destination, source and alpha
+ */
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "blendKernels.h"
+#include "timing.h"
+
+using namespace std;
+
+/*************/
+struct Frame
+{
+    int width;
+    int height;
+    vector<uint8_t> dst;
+    vector<uint8_t> src;
+    vector<uint8_t> alpha; // Expanded to 3 channels, as in LayerMerger
+};
+
+/*************/
+// Mostly fully opaque or transparent pixels, with partial values around the edges, like our masks
+static Frame createFrame(int width, int height)
+{
+    Frame frame {width, height, {}, {}, {}};
+    size_t size = width * height * 3;
+    frame.dst.resize(size);
+    frame.src.resize(size);
+    frame.alpha.resize(size);
+
+    mt19937 rng(42);
+    uniform_int_distribution<int> byte(0, 255);
+    for (size_t i = 0; i < size; ++i)
+    {
+        frame.dst[i] = byte(rng);
+        frame.src[i] = byte(rng);
+    }
+
+    for (int i = 0; i < width * height; ++i)
+    {
+        int x = i % width;
+        int a = x < width / 3 ? 0 : (x > width / 3 + 8 ? 255 : byte(rng));
+        if (byte(rng) < 16)
+            a = byte(rng);
+        for (int c = 0; c < 3; ++c)
+            frame.alpha[i * 3 + c] = a;
+    }
+
+    return frame;
+}
+
+/*************/
+// Same as the loop formerly found in LayerMerger::mergeLayersWithMasks
+static void blendReference(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, int width, int height)
+{
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            int index = (y * width + x) * 3;
+            auto alphaValue = alpha[index];
+            if (alphaValue == 0)
+            {
+                continue;
+            }
+            else if (alphaValue == 255)
+            {
+                for (int c = 0; c < 3; ++c)
+                    dst[index + c] = src[index + c];
+            }
+            else
+            {
+                for (int c = 0; c < 3; ++c)
+                    dst[index + c] = ((255 - alphaValue) * dst[index + c] + alphaValue * src[index + c]) / 255;
+            }
+        }
+}
+
+/*************/
+// Same as cv::Mat::mul(alpha, 1.0 / 255.0), which rounds to the nearest integer
+static void multiplyReference(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+        dst[i] = static_cast<uint8_t>(lround(src[i] * alpha[i] / 255.0));
+}
+
+/*************/
+typedef void (*KernelFunction)(uint8_t*, const uint8_t*, const uint8_t*, size_t);
+
+/*************/
+template<typename Reference>
+static bool benchmarkKernel(const Frame& frame, const string& name, Reference reference, KernelFunction function, int iterations)
+{
+    size_t size = frame.dst.size();
+    vector<uint8_t> expected = frame.dst;
+    vector<uint8_t> result(size);
+
+    reference(expected.data());
+
+    double referenceTime = timing::measure([&]() {
+        memcpy(result.data(), frame.dst.data(), size);
+        reference(result.data());
+    }, iterations);
+    cout << "  " << name << ", reference: " << referenceTime << " ms/frame" << endl;
+
+    bool success = true;
+    for (auto kernel : {blend::Kernel::scalar, blend::Kernel::sse2, blend::Kernel::avx2})
+    {
+        if (!blend::setKernel(kernel))
+        {
+            cout << "  " << name << ", " << blend::getKernelName(kernel) << ": not supported by this CPU" << endl;
+            continue;
+        }
+
+        double kernelTime = timing::measure([&]() {
+            memcpy(result.data(), frame.dst.data(), size);
+            function(result.data(), frame.src.data(), frame.alpha.data(), size);
+        }, iterations);
+
+        bool identical = (result == expected);
+        success &= identical;
+
+        double throughput = size / (kernelTime * 1000.0);
+        cout << "  " << name << ", " << blend::getKernelName(kernel) << ": " << kernelTime << " ms/frame, " << throughput << " MB/s, x"
+             << referenceTime / kernelTime << (identical ? "" : " - OUTPUT DIFFERS FROM REFERENCE") << endl;
+    }
+
+    blend::setKernel(blend::Kernel::automatic);
+    return success;
+}
+
+/*************/
+static bool benchmark(int width, int height, int iterations)
+{
+    auto frame = createFrame(width, height);
+    vector<uint8_t> premultiplied(frame.src.size());
+
+    cout << width << "x" << height << ":" << endl;
+
+    bool success = true;
+    success &= benchmarkKernel(frame, "blend", [&](uint8_t* dst) {
+        blendReference(dst, frame.src.data(), frame.alpha.data(), width, height);
+    }, blend::blendWithAlpha, iterations);
+
+    success &= benchmarkKernel(frame, "multiply and blend", [&](uint8_t* dst) {
+        multiplyReference(premultiplied.data(), frame.src.data(), frame.alpha.data(), premultiplied.size());
+        blendReference(dst, premultiplied.data(), frame.alpha.data(), width, height);
+    }, blend::multiplyAndBlendWithAlpha, iterations);
+
+    return success;
+}
+
+/*************/
+static bool validate()
+{
+    bool success = true;
+
+    // The fixed-point divisions, for any product of two bytes
+    for (uint32_t x = 0; x <= 255 * 255; ++x)
+    {
+        if (blend::div255(x) != x / 255 || blend::div255Round(x) != static_cast<uint32_t>(lround(x / 255.0)))
+        {
+            cout << "div255 or div255Round is wrong for " << x << endl;
+            success = false;
+            break;
+        }
+    }
+
+    // Every destination and source pair, for each alpha value
+    const size_t size = 256 * 256;
+    vector<uint8_t> dst(size), src(size), alpha(size), result(size);
+    vector<uint8_t> expectedBlend(size), expectedMultiply(size), expectedMultiplyAndBlend(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        dst[i] = i & 0xFF;
+        src[i] = i >> 8;
+    }
+
+    for (auto kernel : {blend::Kernel::scalar, blend::Kernel::sse2, blend::Kernel::avx2})
+    {
+        if (!blend::setKernel(kernel))
+        {
+            cout << "validation, " << blend::getKernelName(kernel) << ": not supported by this CPU" << endl;
+            continue;
+        }
+
+        unsigned int errors = 0;
+        for (int a = 0; a < 256; ++a)
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                alpha[i] = a;
+                expectedBlend[i] = ((255 - a) * dst[i] + a * src[i]) / 255;
+                expectedMultiply[i] = (src[i] * a + 127) / 255;
+                expectedMultiplyAndBlend[i] = ((255 - a) * dst[i] + a * expectedMultiply[i]) / 255;
+            }
+
+            result = dst;
+            blend::blendWithAlpha(result.data(), src.data(), alpha.data(), size);
+            errors += (result != expectedBlend);
+
+            result = dst;
+            blend::multiplyAndBlendWithAlpha(result.data(), src.data(), alpha.data(), size);
+            errors += (result != expectedMultiplyAndBlend);
+
+            blend::multiply(result.data(), src.data(), alpha.data(), size);
+            errors += (result != expectedMultiply);
+        }
+
+        cout << "validation, " << blend::getKernelName(kernel) << ": " << (errors == 0 ? "exact" : "MISMATCH") << " on all 256x256x256 inputs" << endl;
+        success &= (errors == 0);
+    }
+
+    blend::setKernel(blend::Kernel::automatic);
+    return success;
+}
+
+/*************/
+int main(int argc, char** argv)
+{
+    if (argc > 1 && string(argv[1]) == "--validate")
+        return validate() ? 0 : 1;
+
+    int iterations = 100;
+    if (argc > 1)
+        iterations = stoi(argv[1]);
+
+    bool success = true;
+    success &= benchmark(512, 376, iterations);
+    success &= benchmark(1920, 1080, iterations);
+
+    return success ? 0 : 1;
+}
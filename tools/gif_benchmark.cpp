@@ -0,0 +1,194 @@
+/*
+ * Benchmark of the GIF encoder used by LayerMerger, with a palette per frame,
+ * with a global palette, with delta encoding, with each dithering on one thread
+ * and on all cores, and against the former convertToGif script (GNU parallel,
+ * mogrify and convert from ImageMagick)
+ *
+ * Usage: gif_benchmark [FRAMES]
+ * FRAMES defaults to 30, at the 256x188 size of the recorded frames
+ * The commands of the script are run as it did, and skipped if parallel, mogrify
+ * or convert are not found
+ */
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "gifEncoder.h"
+#include "timing.h"
+
+using namespace std;
+
+/*************/
+// A static background with a gradient, and a moving subject, like our recordings
+static vector<cv::Mat> createFrames(int frameNbr, int width, int height)
+{
+    vector<cv::Mat> frames;
+    for (int f = 0; f < frameNbr; ++f)
+    {
+        cv::Mat frame(height, width, CV_8UC3);
+        float centerX = width * (0.3f + 0.4f * f / frameNbr);
+        float centerY = height * 0.5f;
+        for (int y = 0; y < height; ++y)
+        {
+            uint8_t* row = frame.ptr<uint8_t>(y);
+            for (int x = 0; x < width; ++x)
+            {
+                float distance = sqrt((x - centerX) * (x - centerX) + (y - centerY) * (y - centerY));
+                if (distance < height / 4)
+                {
+                    row[x * 3 + 0] = 90 + distance;
+                    row[x * 3 + 1] = 120 + distance;
+                    row[x * 3 + 2] = 200 - distance / 2;
+                }
+                else
+                {
+                    row[x * 3 + 0] = x * 255 / width;
+                    row[x * 3 + 1] = 64 + ((x / 8 + y / 8) % 2) * 32;
+                    row[x * 3 + 2] = y * 255 / height;
+                }
+            }
+        }
+        frames.push_back(frame);
+    }
+
+    return frames;
+}
+
+/*************/
+static long getFileSize(const string& filename)
+{
+    struct stat status;
+    if (stat(filename.c_str(), &status) < 0)
+        return -1;
+    return status.st_size;
+}
+
+/*************/
+static string getFrameFilename(const string& basename, int index)
+{
+    return basename + "_" + (index < 10 ? "0" : "") + to_string(index) + ".png";
+}
+
+/*************/
+// Same commands as the former convertToGif script, run from /tmp
+static string getScriptCommand(const string& basename)
+{
+    return "cd /tmp && SHELL=/bin/bash parallel 'mogrify -format gif {}' ::: " + basename + "* && convert -delay 0.8 -loop 0 " + basename + "*.gif "
+           + basename + ".gif";
+}
+
+/*************/
+int main(int argc, char** argv)
+{
+    int frameNbr = argc > 1 ? stoi(argv[1]) : 30;
+
+    auto frames = createFrames(frameNbr, 256, 188);
+    const string basename = "gifbench_result_1";
+    const string directory = "/tmp/";
+
+    // Encoding from memory, with a palette per frame then with a global palette
+    auto start = chrono::high_resolution_clock::now();
+    GifEncoder encoder;
+    bool success = encoder.open(directory + basename + "_local.gif", frames[0].size());
+    for (auto& frame : frames)
+        success &= encoder.addFrame(frame, 10);
+    success &= encoder.close();
+    double localTime = timing::getElapsed(start);
+    cout << "Native encoder, from memory, palette per frame: " << localTime << " ms, " << localTime / frameNbr << " ms/frame, "
+         << getFileSize(directory + basename + "_local.gif") << " bytes" << endl;
+
+    start = chrono::high_resolution_clock::now();
+    gif::Histogram histogram;
+    for (auto& frame : frames)
+        histogram.add(frame, 2);
+    GifEncoder fullFrameEncoder;
+    fullFrameEncoder.setDeltaEncoding(false);
+    success &= fullFrameEncoder.open(directory + basename + "_global.gif", frames[0].size(), gif::buildPalette(histogram, 256));
+    for (auto& frame : frames)
+        success &= fullFrameEncoder.addFrame(frame, 10);
+    success &= fullFrameEncoder.close();
+    double globalTime = timing::getElapsed(start);
+    cout << "Native encoder, from memory, global palette: " << globalTime << " ms, " << globalTime / frameNbr << " ms/frame, "
+         << getFileSize(directory + basename + "_global.gif") << " bytes, x" << localTime / globalTime << " faster" << endl;
+
+    start = chrono::high_resolution_clock::now();
+    success &= GifEncoder::encode(frames, directory + basename + "_memory.gif", 10);
+    double memoryTime = timing::getElapsed(start);
+    cout << "Native encoder, from memory, global palette and delta encoding: " << memoryTime << " ms, " << memoryTime / frameNbr << " ms/frame, "
+         << getFileSize(directory + basename + "_memory.gif") << " bytes, x" << localTime / memoryTime << " faster" << endl;
+
+    // Dithering, which also makes the frames harder to compress
+    unsigned int coreNbr = max(1u, thread::hardware_concurrency());
+    for (auto dithering : {gif::Dithering::none, gif::Dithering::ordered, gif::Dithering::errorDiffusion})
+    {
+        for (auto threadNbr : {1u, coreNbr})
+        {
+            auto filename = directory + basename + "_" + gif::getDitheringName(dithering) + ".gif";
+            start = chrono::high_resolution_clock::now();
+            success &= GifEncoder::encode(frames, filename, 10, dithering, threadNbr);
+            double ditheringTime = timing::getElapsed(start);
+            cout << "Native encoder, from memory, " << gif::getDitheringName(dithering) << " dithering, " << threadNbr << " thread(s): "
+                 << ditheringTime << " ms, " << ditheringTime / frameNbr << " ms/frame, " << getFileSize(filename) << " bytes, x"
+                 << ditheringTime / memoryTime << " the time without dithering" << endl;
+            remove(filename.c_str());
+
+            if (coreNbr == 1)
+                break;
+        }
+    }
+
+    // Encoding from the recorded PNG files, as LayerMerger does
+    for (int i = 0; i < frameNbr; ++i)
+        cv::imwrite(directory + getFrameFilename(basename, i), frames[i], {cv::IMWRITE_PNG_COMPRESSION, 9});
+
+    start = chrono::high_resolution_clock::now();
+    vector<cv::Mat> loadedFrames;
+    for (int i = 0; i < frameNbr; ++i)
+        loadedFrames.push_back(cv::imread(directory + getFrameFilename(basename, i), cv::IMREAD_COLOR));
+    success &= GifEncoder::encode(loadedFrames, directory + basename + "_native.gif", 10);
+    double nativeTime = timing::getElapsed(start);
+    cout << "Native encoder, from PNG files: " << nativeTime << " ms, " << nativeTime / frameNbr << " ms/frame, "
+         << getFileSize(directory + basename + "_native.gif") << " bytes" << endl;
+
+    // The former script, on the same PNG files. It converts every file starting with
+    // the basename, so the native outputs are removed before running it
+    for (auto& suffix : {"_local", "_global", "_memory", "_native"})
+        remove((directory + basename + suffix + ".gif").c_str());
+
+    if (system("command -v parallel mogrify convert > /dev/null 2>&1") != 0)
+    {
+        cout << "convertToGif script: skipped, GNU parallel and ImageMagick are needed" << endl;
+    }
+    else
+    {
+        start = chrono::high_resolution_clock::now();
+        int result = system(getScriptCommand(basename).c_str());
+        double scriptTime = timing::getElapsed(start);
+        if (result != 0)
+            cout << "convertToGif script: failed" << endl;
+        else
+            cout << "convertToGif script: " << scriptTime << " ms, " << scriptTime / frameNbr << " ms/frame, "
+                 << getFileSize(directory + basename + ".gif") << " bytes, x" << scriptTime / nativeTime << " slower" << endl;
+        remove((directory + basename + ".gif").c_str());
+    }
+
+    for (int i = 0; i < frameNbr; ++i)
+    {
+        auto filename = directory + getFrameFilename(basename, i);
+        remove(filename.c_str());
+        remove((filename.substr(0, filename.size() - 4) + ".gif").c_str()); // Converted by the script
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+/*
+ * Throughput benchmark of the LZW compressor used by the GIF encoder
+ * Checks that it gives the same output as the former dictionary based on
+ * std::unordered_map, and measures both in MB/s of palette indices
+ *
+ * Usage: lzw_benchmark [ITERATIONS] [FRAMES] [FPS]
+ * FRAMES and FPS describe the film loop, 30 frames at 5 fps by default, to tell
+ * whether a recording of that many 512x376 frames is compressed within one loop
+ */
+
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gifLzw.h"
+#include "timing.h"
+
+using namespace std;
+
+/*************/
+// Palette indices of a frame at the size of the composited output
+struct Frame
+{
+    string name;
+    vector<uint8_t> indices;
+};
+
+/*************/
+static vector<Frame> createFrames(int width, int height)
+{
+    vector<Frame> frames;
+    mt19937 rng(42);
+    uniform_int_distribution<int> byte(0, 255);
+
+    // A gradient background and a flat subject, as mapped from a recording
+    Frame smooth {"smooth", vector<uint8_t>(width * height)};
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            int dx = x - width / 2;
+            int dy = y - height / 2;
+            smooth.indices[y * width + x] = dx * dx + dy * dy < height * height / 16 ? 200 + (x + y) % 3 : (x / 8 + y / 16 * 32) & 0xFF;
+        }
+    frames.push_back(smooth);
+
+    // Same with dithering noise
+    Frame dithered {"dithered", smooth.indices};
+    for (auto& index : dithered.indices)
+        if (byte(rng) < 96)
+            index = (index + 1) & 0xFF;
+    frames.push_back(dithered);
+
+    // A delta encoded frame, mostly transparent
+    Frame delta {"delta", vector<uint8_t>(width * height, 255)};
+    for (int y = height / 3; y < height * 2 / 3; ++y)
+        for (int x = width / 3; x < width / 2; ++x)
+            delta.indices[y * width + x] = smooth.indices[y * width + x];
+    frames.push_back(delta);
+
+    // The worst case, which fills the dictionary quickly
+    Frame noise {"noise", vector<uint8_t>(width * height)};
+    for (auto& index : noise.indices)
+        index = byte(rng);
+    frames.push_back(noise);
+
+    return frames;
+}
+
+/*************/
+// Same as the former GifEncoder::writeImageData
+static void compressReference(const uint8_t* indices, size_t count, int minCodeSize, vector<uint8_t>& data)
+{
+    data.push_back(minCodeSize);
+
+    const int clearCode = 1 << minCodeSize;
+    const int endCode = clearCode + 1;
+    const int maxCode = 4096;
+
+    vector<uint8_t> block;
+    block.reserve(255);
+    uint32_t bitBuffer = 0;
+    int bitCount = 0;
+    int codeSize = minCodeSize + 1;
+
+    auto flushBlock = [&]() {
+        data.push_back(block.size());
+        data.insert(data.end(), block.begin(), block.end());
+        block.clear();
+    };
+
+    auto writeCode = [&](int code) {
+        bitBuffer |= static_cast<uint32_t>(code) << bitCount;
+        bitCount += codeSize;
+        while (bitCount >= 8)
+        {
+            block.push_back(bitBuffer & 0xFF);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+            if (block.size() == 255)
+                flushBlock();
+        }
+    };
+
+    unordered_map<uint32_t, uint16_t> dictionary;
+    int nextCode = endCode + 1;
+
+    writeCode(clearCode);
+    if (count != 0)
+    {
+        int prefix = indices[0];
+        for (size_t i = 1; i < count; ++i)
+        {
+            uint32_t key = (static_cast<uint32_t>(prefix) << 8) | indices[i];
+            auto entry = dictionary.find(key);
+            if (entry != dictionary.end())
+            {
+                prefix = entry->second;
+                continue;
+            }
+
+            writeCode(prefix);
+            if (nextCode < maxCode)
+            {
+                if (nextCode >= (1 << codeSize))
+                    codeSize++;
+                dictionary[key] = nextCode++;
+            }
+            else
+            {
+                writeCode(clearCode);
+                dictionary.clear();
+                nextCode = endCode + 1;
+                codeSize = minCodeSize + 1;
+            }
+
+            prefix = indices[i];
+        }
+
+        writeCode(prefix);
+        if (nextCode >= (1 << codeSize) && codeSize < 12)
+            codeSize++;
+    }
+    writeCode(endCode);
+
+    if (bitCount > 0)
+    {
+        block.push_back(bitBuffer & 0xFF);
+        if (block.size() == 255)
+            flushBlock();
+    }
+    if (block.size() > 0)
+        flushBlock();
+
+    data.push_back(0);
+}
+
+/*************/
+int main(int argc, char** argv)
+{
+    int iterations = argc > 1 ? stoi(argv[1]) : 100;
+    int loopFrames = argc > 2 ? stoi(argv[2]) : 30;
+    float fps = argc > 3 ? stof(argv[3]) : 5.f;
+
+    const int width = 512;
+    const int height = 376;
+    const double loopTime = loopFrames / fps * 1000.0;
+
+    bool success = true;
+    gif::LzwEncoder encoder;
+    vector<uint8_t> data;
+    vector<uint8_t> expected;
+
+    cout << width << "x" << height << ", film loop of " << loopFrames << " frames at " << fps << " fps (" << loopTime << " ms):" << endl;
+    for (auto& frame : createFrames(width, height))
+    {
+        const uint8_t* indices = frame.indices.data();
+        size_t count = frame.indices.size();
+
+        expected.clear();
+        compressReference(indices, count, 8, expected);
+        data.clear();
+        encoder.compress(indices, count, 8, data);
+        bool identical = (data == expected);
+        success &= identical;
+
+        double referenceTime = timing::measure([&]() {
+            data.clear();
+            compressReference(indices, count, 8, data);
+        }, iterations);
+
+        double time = timing::measure([&]() {
+            data.clear();
+            encoder.compress(indices, count, 8, data);
+        }, iterations);
+
+        double recordTime = time * loopFrames;
+        cout << "  " << frame.name << ", " << data.size() * 100.0 / count << "% of the input:" << endl;
+        cout << "    reference: " << referenceTime << " ms/frame, " << count / (referenceTime * 1000.0) << " MB/s" << endl;
+        cout << "    hash table: " << time << " ms/frame, " << count / (time * 1000.0) << " MB/s, x" << referenceTime / time
+             << (identical ? "" : " - OUTPUT DIFFERS FROM REFERENCE") << endl;
+        cout << "    whole recording: " << recordTime << " ms, " << recordTime * 100.0 / loopTime << "% of the film loop" << endl;
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ * Reads the frames published by gifengine in shared memory, see ShmOutput
+ * Reports the received framerate, the dropped frames and the latency
+ *
+ * Usage: shm_reader [NAME] [SECONDS]
+ * NAME defaults to gifbox, SECONDS to 0 which runs until interrupted
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "shmOutput.h"
+
+using namespace std;
+
+/*************/
+struct Segment
+{
+    const uint8_t* data {nullptr};
+    size_t size {0};
+
+    const shm::ShmHeader* getHeader() const {return reinterpret_cast<const shm::ShmHeader*>(data);}
+    const shm::ShmSlotHeader* getSlotHeader(unsigned int slot) const
+    {
+        return reinterpret_cast<const shm::ShmSlotHeader*>(data + shm::headerSize + slot * getHeader()->slotStride);
+    }
+    const uint8_t* getSlotData(unsigned int slot) const
+    {
+        return data + shm::headerSize + slot * getHeader()->slotStride + shm::slotHeaderSize;
+    }
+};
+
+/*************/
+static bool openSegment(const string& name, Segment& segment)
+{
+    int fd = shm_open(("/" + name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(fd, &status) < 0 || static_cast<size_t>(status.st_size) < shm::headerSize)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    segment.data = static_cast<const uint8_t*>(data);
+    segment.size = status.st_size;
+
+    auto header = segment.getHeader();
+    if (memcmp(header->magic, shm::magic, sizeof(shm::magic)) != 0 || header->version != shm::version
+        || shm::headerSize + header->slotNbr * header->slotStride > segment.size)
+    {
+        cout << "Shared memory /" << name << " is not a gifbox frame ring, or has another version" << endl;
+        munmap(const_cast<uint8_t*>(segment.data), segment.size);
+        segment = Segment();
+        return false;
+    }
+
+    cout << "Opened /" << name << ": " << header->slotNbr << " slots of " << header->slotSize << " bytes" << endl;
+    return true;
+}
+
+/*************/
+static uint64_t getTime()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + now.tv_nsec;
+}
+
+/*************/
+int main(int argc, char** argv)
+{
+    string name = argc > 1 ? argv[1] : "gifbox";
+    int duration = argc > 2 ? stoi(argv[2]) : 0;
+
+    Segment segment;
+    uint64_t start = getTime();
+    uint64_t lastReport = start;
+    uint64_t lastReceived = start;
+    uint64_t lastFrame = 0;
+
+    uint64_t received = 0, dropped = 0, torn = 0;
+    uint64_t totalReceived = 0, totalDropped = 0;
+    double latency = 0.0;
+    uint32_t checksum = 0;
+
+    while (duration == 0 || getTime() - start < static_cast<uint64_t>(duration) * 1000000000ull)
+    {
+        uint64_t now = getTime();
+
+        // The writer creates a new segment when it restarts or the frame size changes
+        if (segment.data && now - lastReceived > 2000000000ull)
+        {
+            munmap(const_cast<uint8_t*>(segment.data), segment.size);
+            segment = Segment();
+            lastFrame = 0;
+        }
+
+        if (!segment.data)
+        {
+            if (!openSegment(name, segment))
+            {
+                this_thread::sleep_for(chrono::milliseconds(500));
+                continue;
+            }
+            lastReceived = now;
+            lastReport = now;
+        }
+
+        auto header = segment.getHeader();
+        unsigned int slot = header->latestSlot.load(memory_order_acquire);
+        if (slot >= header->slotNbr)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
+
+        // Seqlock read: the frame is used in place, then the sequence is checked again
+        auto slotHeader = segment.getSlotHeader(slot);
+        uint32_t sequence = slotHeader->sequence.load(memory_order_acquire);
+        uint64_t frameNumber = slotHeader->frameNumber;
+        if (sequence % 2 == 1 || frameNumber == lastFrame)
+        {
+            this_thread::sleep_for(chrono::microseconds(500));
+            continue;
+        }
+
+        uint64_t timestamp = slotHeader->timestamp;
+        uint64_t size = min<uint64_t>(slotHeader->size, header->slotSize);
+        const uint8_t* data = segment.getSlotData(slot);
+        uint32_t frameChecksum = 0;
+        for (uint64_t i = 0; i < size; i += 4096)
+            frameChecksum += data[i];
+
+        atomic_thread_fence(memory_order_acquire);
+        if (slotHeader->sequence.load(memory_order_relaxed) != sequence)
+        {
+            torn++;
+            continue;
+        }
+
+        checksum += frameChecksum;
+        received++;
+        if (lastFrame != 0 && frameNumber > lastFrame + 1)
+            dropped += frameNumber - lastFrame - 1;
+        lastFrame = frameNumber;
+        lastReceived = now;
+        latency += (now - timestamp) / 1e6;
+
+        if (now - lastReport >= 1000000000ull)
+        {
+            double seconds = (now - lastReport) / 1e9;
+            cout << received / seconds << " fps, " << dropped << " dropped, " << torn << " torn reads, " << latency / received << " ms latency" << endl;
+            totalReceived += received;
+            totalDropped += dropped;
+            received = dropped = torn = 0;
+            latency = 0.0;
+            lastReport = now;
+        }
+    }
+
+    totalReceived += received;
+    totalDropped += dropped;
+    cout << "Total: " << totalReceived << " frames received, " << totalDropped << " dropped (checksum " << checksum << ")" << endl;
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Sends a moving test pattern to a v4l2 output device, to check V4l2Output
+ * against v4l2loopback or vivid without a camera nor a film
+ *
+ * Usage: v4l2_output_test DEVICE [FORMAT] [--mmap] [FRAMES]
+ * FORMAT is one of rgb24, bgr24, yuyv and i420, defaults to rgb24
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+#include "outputFormat.h"
+#include "v4l2output.h"
+
+using namespace std;
+
+/*************/
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: v4l2_output_test DEVICE [FORMAT] [--mmap] [FRAMES]" << endl;
+        return 1;
+    }
+
+    string device = argv[1];
+    auto format = output::Format::rgb24;
+    bool streaming = false;
+    int frameNbr = 300;
+    for (int i = 2; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg == "--mmap")
+            streaming = true;
+        else if (!output::getFormatFromName(arg, format))
+            frameNbr = stoi(arg);
+    }
+
+    const int width = 512;
+    const int height = 376;
+    V4l2Output sink(width, height, device, format, streaming);
+    if (!sink)
+        return 1;
+
+    if (streaming && !sink.isStreaming())
+        cout << "Streaming is not supported by " << device << ", using write()" << endl;
+
+    // Vertical color bars scrolling by one column per frame
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::Mat converted(1, sink.getFrameSize(), CV_8UC1);
+    unsigned int errors = 0;
+
+    auto start = chrono::high_resolution_clock::now();
+    for (int f = 0; f < frameNbr; ++f)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            uint8_t* row = frame.ptr<uint8_t>(y);
+            for (int x = 0; x < width; ++x)
+            {
+                int bar = ((x + f) * 8 / width) % 8;
+                row[x * 3 + 0] = (bar & 1) ? 255 : 0;
+                row[x * 3 + 1] = (bar & 2) ? 255 : 0;
+                row[x * 3 + 2] = (bar & 4) ? 255 : 0;
+            }
+        }
+
+        if (sink.isStreaming())
+        {
+            uint8_t* buffer = sink.acquireBuffer();
+            if (!buffer)
+            {
+                errors++;
+                continue;
+            }
+            output::convertRows(frame, buffer, format, 0, height);
+            errors += !sink.queueBuffer(buffer);
+        }
+        else
+        {
+            output::convertRows(frame, converted.data, format, 0, height);
+            errors += !sink.writeToDevice(converted.data, converted.total());
+        }
+    }
+    auto end = chrono::high_resolution_clock::now();
+
+    double seconds = chrono::duration_cast<chrono::microseconds>(end - start).count() / 1e6;
+    cout << frameNbr << " frames sent to " << device << " as " << output::getFormatName(format) << (sink.isStreaming() ? " (mmap)" : " (write)")
+         << " in " << seconds << " s, " << frameNbr / seconds << " fps, " << errors << " error(s)" << endl;
+
+    return errors == 0 ? 0 : 1;
+}